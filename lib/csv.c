@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <math.h>
 #include <string.h>
 
 #define csv_malloc(size)    malloc(size)
@@ -255,6 +256,8 @@ float* csv_column_float(CSV* csv, const char* col_name)
             arr[row-row_start] = (float)cell.val_int;
         else if (cell.type == CSV_FLOAT)
             arr[row-row_start] = cell.val_float;
+        else if (cell.type == CSV_EMPTY)
+            arr[row-row_start] = NAN;
         else {
             csv_print("Invalid cell type when flattening column %s to float array", col_name);
             csv_free(arr);
@@ -288,6 +291,8 @@ double* csv_column_double(CSV* csv, const char* col_name)
             arr[row-row_start] = (double)cell.val_int;
         else if (cell.type == CSV_FLOAT)
             arr[row-row_start] = cell.val_float;
+        else if (cell.type == CSV_EMPTY)
+            arr[row-row_start] = NAN;
         else {
             csv_print("Invalid cell type when flattening column %s to float array", col_name);
             csv_free(arr);
@@ -474,6 +479,74 @@ void csv_one_hot_encode(CSV* csv, const char* col_name)
     trie_destroy(trie);
 }
 
+CSVOneHot* csv_one_hot_encode_sparse(CSV* csv, const char* col_name)
+{
+    CSVOneHot* one_hot;
+    Trie* trie;
+    Cell* cell;
+    char* string;
+    int i, n, len;
+    int row, col;
+    int row_start, row_end;
+
+    col = csv_column_id(csv, col_name);
+    if (col == -1) {
+        csv_print("Could not find column %s to one-hot encode", col_name);
+        return NULL;
+    }
+    row_start = 1;
+    row_end = csv->num_rows - 1;
+
+    trie = trie_create();
+
+    one_hot = csv_malloc(sizeof(CSVOneHot));
+    one_hot->num_rows = row_end - row_start + 1;
+    one_hot->ids = csv_malloc(one_hot->num_rows * sizeof(int));
+
+    for (row = row_start; row <= row_end; row++) {
+        cell = csv_cell(csv, row, col);
+        if (cell->type != CSV_STRING) {
+            csv_print("Could not one-hot encode %s cell at (%d %d)", csv_cell_type_str(cell), row, col);
+            one_hot->ids[row-row_start] = -1;
+            continue;
+        }
+        if (!trie_contains(trie, cell->val_string))
+            trie_insert(trie, cell->val_string);
+        one_hot->ids[row-row_start] = trie_key_id(trie, cell->val_string);
+    }
+
+    n = trie_num_unique_keys(trie);
+    one_hot->num_categories = n;
+    one_hot->categories = csv_malloc(n * sizeof(char*));
+    for (i = 0; i < n; i++) {
+        string = trie_id_key(trie, i);
+        len = strlen(string);
+        one_hot->categories[i] = csv_malloc((len+1) * sizeof(char));
+        strncpy(one_hot->categories[i], string, len+1);
+    }
+
+    trie_destroy(trie);
+
+    return one_hot;
+}
+
+void csv_one_hot_destroy(CSVOneHot* one_hot)
+{
+    for (int i = 0; i < one_hot->num_categories; i++)
+        csv_free(one_hot->categories[i]);
+    csv_free(one_hot->categories);
+    csv_free(one_hot->ids);
+    csv_free(one_hot);
+}
+
+float* csv_one_hot_float(CSVOneHot* one_hot)
+{
+    float* arr = csv_malloc(one_hot->num_rows * sizeof(float));
+    for (int i = 0; i < one_hot->num_rows; i++)
+        arr[i] = (one_hot->ids[i] == -1) ? NAN : one_hot->ids[i];
+    return arr;
+}
+
 int csv_num_rows(CSV* csv)
 {
     return csv->num_rows;
@@ -503,6 +576,28 @@ int csv_column_id(CSV* csv, const char* col_name)
     return -1;
 }
 
+CSVEnum csv_column_type(CSV* csv, const char* col_name)
+{
+    CSVEnum type, cell_type;
+    int row, col;
+
+    col = csv_column_id(csv, col_name);
+    if (col == -1) {
+        csv_print("Could not find column %s to type", col_name);
+        return CSV_EMPTY;
+    }
+
+    // the cell types are ordered from narrowest to widest
+    type = CSV_EMPTY;
+    for (row = 1; row < csv->num_rows; row++) {
+        cell_type = csv_cell(csv, row, col)->type;
+        if (cell_type > type)
+            type = cell_type;
+    }
+
+    return type;
+}
+
 Cell* csv_cell(CSV* csv, int row, int col)
 {
     return &csv->cells[row * csv->num_cols + col];
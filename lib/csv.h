@@ -29,6 +29,15 @@ typedef struct {
     Trie* trie;
 } CSV;
 
+// sparse one hot encoding of a column. instead of one 0/1 column per category, each
+// row stores the id of its category. ids are -1 for rows that are not strings
+typedef struct {
+    int num_rows;
+    int num_categories;
+    int* ids;
+    char** categories;
+} CSVOneHot;
+
 // Object creation/deletion
 CSV*        csv_read(const char* path);
 void        csv_write(CSV* csv, const char* path);
@@ -46,6 +55,10 @@ const char* csv_string(CSV* csv, int row, int col);
 const char* csv_column_name(CSV* csv, int col);
 int         csv_column_id(CSV* csv, const char* col_name);
 
+// widest type of the cells below the header: CSV_STRING if any is a string, otherwise
+// CSV_FLOAT if any is a float, CSV_INT if any is an int, and CSV_EMPTY if all are empty
+CSVEnum     csv_column_type(CSV* csv, const char* col_name);
+
 // ----- Cell Queries -----
 // does no type checking
 const char* csv_cell_type_str(Cell* cell);
@@ -62,7 +75,7 @@ const char* csv_cell_string(Cell* cell);
 int*        csv_column_int(CSV* csv, const char* col_name);
 long long*  csv_column_long(CSV* csv, const char* col_name);
 
-// returns NULL if cell is not an int or float
+// returns NULL if cell is not an int, float or empty. empty cells are NaN
 float*      csv_column_float(CSV* csv, const char* col_name);
 double*     csv_column_double(CSV* csv, const char* col_name);
 
@@ -79,4 +92,13 @@ const char* csv_decode(CSV* csv, int id);
 // one hot encode to remove biases
 void        csv_one_hot_encode(CSV* csv, const char* col_name);
 
+// one hot encode without expanding the table. the csv is not modified
+// row i of the result corresponds to row i+1 of the csv
+CSVOneHot*  csv_one_hot_encode_sparse(CSV* csv, const char* col_name);
+void        csv_one_hot_destroy(CSVOneHot* one_hot);
+
+// the ids as a float column, NaN where they are -1. a decision tree can train on it
+// as a categorical attribute
+float*      csv_one_hot_float(CSVOneHot* one_hot);
+
 #endif
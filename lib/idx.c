@@ -0,0 +1,278 @@
+#include "idx.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define idx_print(s, ...)   printf(s "\n", __VA_ARGS__)
+
+typedef struct IDX {
+    IDXEnum type;
+    int num_dims;
+    int* dims;
+    int num_items;
+    int item_size;
+    uint8_t* payload;
+    uint8_t* map;
+    size_t map_size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} IDX;
+
+static int element_size(int type)
+{
+    switch (type) {
+        case IDX_UINT8:
+        case IDX_INT8:
+            return 1;
+        case IDX_INT16:
+            return 2;
+        case IDX_INT32:
+        case IDX_FLOAT:
+            return 4;
+        case IDX_DOUBLE:
+            return 8;
+    }
+    return 0;
+}
+
+static uint32_t read_big_endian(uint8_t* bytes, int size)
+{
+    uint32_t res = 0;
+    for (int i = 0; i < size; i++)
+        res = (res << 8) | bytes[i];
+    return res;
+}
+
+#ifdef _WIN32
+
+static int map_file(IDX* idx, const char* path)
+{
+    LARGE_INTEGER size;
+
+    idx->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (idx->file == INVALID_HANDLE_VALUE)
+        return 0;
+    if (!GetFileSizeEx(idx->file, &size) || size.QuadPart == 0) {
+        CloseHandle(idx->file);
+        return 0;
+    }
+    idx->map_size = size.QuadPart;
+    idx->mapping = CreateFileMappingA(idx->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (idx->mapping == NULL) {
+        CloseHandle(idx->file);
+        return 0;
+    }
+    idx->map = MapViewOfFile(idx->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (idx->map == NULL) {
+        CloseHandle(idx->mapping);
+        CloseHandle(idx->file);
+        return 0;
+    }
+    return 1;
+}
+
+static void unmap_file(IDX* idx)
+{
+    UnmapViewOfFile(idx->map);
+    CloseHandle(idx->mapping);
+    CloseHandle(idx->file);
+}
+
+#else
+
+static int map_file(IDX* idx, const char* path)
+{
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return 0;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    idx->map_size = st.st_size;
+    idx->map = mmap(NULL, idx->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (idx->map == MAP_FAILED)
+        return 0;
+    return 1;
+}
+
+static void unmap_file(IDX* idx)
+{
+    munmap(idx->map, idx->map_size);
+}
+
+#endif
+
+// Magic number is two zero bytes, the element type and the number of dimensions, followed by
+// each dimension as a big endian 32 bit integer. The payload must fit in size_t and its number
+// of elements in an int
+static int parse_header(IDX* idx, const char* path)
+{
+    uint8_t* map = idx->map;
+    size_t header_size, payload_size;
+    uint32_t dim;
+    int i;
+
+    if (idx->map_size < 4 || map[0] != 0 || map[1] != 0) {
+        idx_print("Invalid magic number in idx file: %s", path);
+        return 0;
+    }
+
+    idx->type = map[2];
+    if (element_size(idx->type) == 0) {
+        idx_print("Unknown element type 0x%02X in idx file: %s", map[2], path);
+        return 0;
+    }
+
+    idx->num_dims = map[3];
+    if (idx->num_dims == 0) {
+        idx_print("No dimensions in idx file: %s", path);
+        return 0;
+    }
+
+    header_size = 4 + 4 * (size_t)idx->num_dims;
+    if (idx->map_size < header_size) {
+        idx_print("Truncated header in idx file: %s", path);
+        return 0;
+    }
+
+    idx->dims = malloc(idx->num_dims * sizeof(int));
+    payload_size = element_size(idx->type);
+    for (i = 0; i < idx->num_dims; i++) {
+        dim = read_big_endian(map + 4 + 4 * i, 4);
+        if (dim > 0x7FFFFFFF) {
+            idx_print("Dimension too large in idx file: %s", path);
+            return 0;
+        }
+        idx->dims[i] = dim;
+        if (dim != 0 && payload_size > SIZE_MAX / dim) {
+            idx_print("Payload too large in idx file: %s", path);
+            return 0;
+        }
+        payload_size *= dim;
+    }
+
+    if (idx->map_size - header_size < payload_size) {
+        idx_print("Truncated payload in idx file: %s", path);
+        return 0;
+    }
+
+    idx->num_items = idx->dims[0];
+    idx->item_size = 1;
+    for (i = 1; i < idx->num_dims; i++) {
+        if (idx->dims[i] != 0 && idx->item_size > INT_MAX / idx->dims[i]) {
+            idx_print("Items too large in idx file: %s", path);
+            return 0;
+        }
+        idx->item_size *= idx->dims[i];
+    }
+    if (idx->item_size != 0 && idx->num_items > INT_MAX / idx->item_size) {
+        idx_print("Too many elements in idx file: %s", path);
+        return 0;
+    }
+    idx->payload = map + header_size;
+
+    return 1;
+}
+
+IDX* idx_open(const char* path)
+{
+    IDX* idx = calloc(1, sizeof(IDX));
+
+    if (!map_file(idx, path)) {
+        idx_print("Could not map idx file for reading: %s", path);
+        free(idx);
+        return NULL;
+    }
+
+    if (!parse_header(idx, path)) {
+        idx_close(idx);
+        return NULL;
+    }
+
+    return idx;
+}
+
+void idx_close(IDX* idx)
+{
+    unmap_file(idx);
+    free(idx->dims);
+    free(idx);
+}
+
+IDXEnum idx_type(IDX* idx)
+{
+    return idx->type;
+}
+
+int idx_num_dims(IDX* idx)
+{
+    return idx->num_dims;
+}
+
+int idx_dim(IDX* idx, int i)
+{
+    return idx->dims[i];
+}
+
+int idx_num_items(IDX* idx)
+{
+    return idx->num_items;
+}
+
+int idx_item_size(IDX* idx)
+{
+    return idx->item_size;
+}
+
+uint8_t* idx_uint8(IDX* idx)
+{
+    if (idx->type != IDX_UINT8)
+        return NULL;
+    return idx->payload;
+}
+
+int* idx_int(IDX* idx)
+{
+    int* arr;
+    int i, n, size;
+    uint8_t* element;
+
+    if (idx->type == IDX_FLOAT || idx->type == IDX_DOUBLE) {
+        puts("Could not convert floating point idx payload to int array");
+        return NULL;
+    }
+
+    n = idx->num_items * idx->item_size;
+    size = element_size(idx->type);
+    arr = malloc((size_t)n * sizeof(int));
+
+    for (i = 0; i < n; i++) {
+        element = idx->payload + (size_t)i * size;
+        if (idx->type == IDX_UINT8)
+            arr[i] = element[0];
+        else if (idx->type == IDX_INT8)
+            arr[i] = (int8_t)element[0];
+        else if (idx->type == IDX_INT16)
+            arr[i] = (int16_t)read_big_endian(element, 2);
+        else
+            arr[i] = (int32_t)read_big_endian(element, 4);
+    }
+
+    return arr;
+}
@@ -0,0 +1,47 @@
+#ifndef IDX_H
+#define IDX_H
+
+#include <stdint.h>
+
+typedef enum {
+
+    // Element types, as encoded in the third byte of the magic number
+    IDX_UINT8   = 0x08,
+    IDX_INT8    = 0x09,
+    IDX_INT16   = 0x0B,
+    IDX_INT32   = 0x0C,
+    IDX_FLOAT   = 0x0D,
+    IDX_DOUBLE  = 0x0E,
+
+} IDXEnum;
+
+typedef struct IDX IDX;
+
+// Memory maps an IDX file (e.g. MNIST's .idx3-ubyte and .idx1-ubyte) and validates its header
+// Returns NULL and prints a message if the file cannot be mapped or is malformed
+IDX*        idx_open(const char* path);
+void        idx_close(IDX* idx);
+
+// ----- IDX Queries -----
+IDXEnum     idx_type(IDX* idx);
+int         idx_num_dims(IDX* idx);
+int         idx_dim(IDX* idx, int i);
+
+// number of items along the first dimension, e.g. the number of images
+int         idx_num_items(IDX* idx);
+
+// number of elements in each item, e.g. rows * cols of an image
+int         idx_item_size(IDX* idx);
+
+// ----- IDX payload -----
+// the payload is mapped, not copied, and stays valid until idx_close
+// num_items * item_size elements stored row by row
+
+// returns NULL if the elements are not IDX_UINT8
+uint8_t*    idx_uint8(IDX* idx);
+
+// copies the elements into an int array, converting from big endian. works for integer types
+// you are responsible for freeing memory
+int*        idx_int(IDX* idx);
+
+#endif
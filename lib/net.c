@@ -0,0 +1,290 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define net_print(s, ...)   printf(s "\n", __VA_ARGS__)
+
+#ifdef _WIN32
+
+NetSocket* net_listen(const char* address)
+{
+    net_print("Sockets are not supported on this platform: %s", address);
+    return NULL;
+}
+
+NetSocket* net_accept(NetSocket* server)
+{
+    (void)server;
+    return NULL;
+}
+
+NetSocket* net_connect(const char* address, int timeout)
+{
+    (void)timeout;
+    net_print("Sockets are not supported on this platform: %s", address);
+    return NULL;
+}
+
+int net_send(NetSocket* sock, const void* buf, size_t size)
+{
+    (void)sock; (void)buf; (void)size;
+    return 0;
+}
+
+int net_recv(NetSocket* sock, void* buf, size_t size)
+{
+    (void)sock; (void)buf; (void)size;
+    return 0;
+}
+
+void net_close(NetSocket* sock)
+{
+    (void)sock;
+}
+
+#else
+
+typedef struct NetSocket {
+    int fd;
+    char* path;
+} NetSocket;
+
+static NetSocket* socket_create(int fd, const char* path)
+{
+    NetSocket* sock = malloc(sizeof(NetSocket));
+    sock->fd = fd;
+    sock->path = NULL;
+    if (path != NULL) {
+        sock->path = malloc(strlen(path) + 1);
+        strcpy(sock->path, path);
+    }
+    return sock;
+}
+
+static int is_unix(const char* address)
+{
+    return strncmp(address, "unix:", 5) == 0;
+}
+
+static int unix_address(const char* address, struct sockaddr_un* addr)
+{
+    const char* path = address + 5;
+    if (strlen(path) == 0 || strlen(path) >= sizeof(addr->sun_path))
+        return 0;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+// Splits "host:port" at its last colon. Returns the addresses to try, or NULL
+static struct addrinfo* tcp_address(const char* address, int passive)
+{
+    struct addrinfo hints, *res;
+    const char* colon;
+    char* host;
+    int n;
+
+    colon = strrchr(address, ':');
+    if (colon == NULL)
+        return NULL;
+    n = colon - address;
+    host = malloc(n + 1);
+    memcpy(host, address, n);
+    host[n] = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = (passive) ? AI_PASSIVE : 0;
+    if (getaddrinfo((n > 0) ? host : NULL, colon + 1, &hints, &res) != 0)
+        res = NULL;
+    free(host);
+    return res;
+}
+
+// Messages are small and each one is answered before the next is sent, so they go out
+// without waiting to be coalesced
+static void set_nodelay(int fd)
+{
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+NetSocket* net_listen(const char* address)
+{
+    struct sockaddr_un addr_un;
+    struct addrinfo* res;
+    struct addrinfo* ai;
+    int fd = -1, one = 1;
+
+    if (is_unix(address)) {
+        if (!unix_address(address, &addr_un)) {
+            net_print("Invalid Unix-domain socket address: %s", address);
+            return NULL;
+        }
+        unlink(addr_un.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1 || bind(fd, (struct sockaddr*)&addr_un, sizeof(addr_un)) == -1 || listen(fd, SOMAXCONN) == -1) {
+            if (fd != -1)
+                close(fd);
+            net_print("Could not listen on address: %s", address);
+            return NULL;
+        }
+        return socket_create(fd, addr_un.sun_path);
+    }
+
+    res = tcp_address(address, 1);
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    if (res != NULL)
+        freeaddrinfo(res);
+    if (fd == -1) {
+        net_print("Could not listen on address: %s", address);
+        return NULL;
+    }
+    return socket_create(fd, NULL);
+}
+
+NetSocket* net_accept(NetSocket* server)
+{
+    int fd;
+
+    do {
+        fd = accept(server->fd, NULL, NULL);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        puts("Could not accept connection");
+        return NULL;
+    }
+    if (server->path == NULL)
+        set_nodelay(fd);
+    return socket_create(fd, NULL);
+}
+
+static int try_connect(const char* address)
+{
+    struct sockaddr_un addr_un;
+    struct addrinfo* res;
+    struct addrinfo* ai;
+    int fd = -1;
+
+    if (is_unix(address)) {
+        if (!unix_address(address, &addr_un))
+            return -1;
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd != -1 && connect(fd, (struct sockaddr*)&addr_un, sizeof(addr_un)) == -1) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+
+    res = tcp_address(address, 0);
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            set_nodelay(fd);
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    if (res != NULL)
+        freeaddrinfo(res);
+    return fd;
+}
+
+NetSocket* net_connect(const char* address, int timeout)
+{
+    struct timespec wait = { 0, 100000000 };
+    int fd, attempt;
+
+    // retry every 100 ms
+    for (attempt = 0; ; attempt++) {
+        fd = try_connect(address);
+        if (fd != -1)
+            return socket_create(fd, NULL);
+        if (attempt >= timeout * 10)
+            break;
+        nanosleep(&wait, NULL);
+    }
+
+    net_print("Could not connect to address: %s", address);
+    return NULL;
+}
+
+int net_send(NetSocket* sock, const void* buf, size_t size)
+{
+    const char* bytes = buf;
+    ssize_t n;
+    int flags = 0;
+
+#ifdef MSG_NOSIGNAL
+    flags = MSG_NOSIGNAL;
+#endif
+    while (size > 0) {
+        n = send(sock->fd, bytes, size, flags);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        bytes += n;
+        size -= n;
+    }
+    return 1;
+}
+
+int net_recv(NetSocket* sock, void* buf, size_t size)
+{
+    char* bytes = buf;
+    ssize_t n;
+
+    while (size > 0) {
+        n = recv(sock->fd, bytes, size, 0);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        bytes += n;
+        size -= n;
+    }
+    return 1;
+}
+
+void net_close(NetSocket* sock)
+{
+    if (sock == NULL)
+        return;
+    close(sock->fd);
+    if (sock->path != NULL)
+        unlink(sock->path);
+    free(sock->path);
+    free(sock);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stddef.h>
+
+typedef struct NetSocket NetSocket;
+
+// Addresses are "host:port" for TCP, e.g. "127.0.0.1:5000", or "unix:path" for a Unix-domain
+// socket, e.g. "unix:/tmp/trainer.sock"
+// Functions that fail return NULL or 0 and print a message
+
+// Listens on address. A Unix-domain socket file left over at path is replaced
+NetSocket*  net_listen(const char* address);
+
+// Waits for the next connection to a listening socket
+NetSocket*  net_accept(NetSocket* server);
+
+// Connects to address, retrying for up to timeout seconds while nothing listens on it yet
+NetSocket*  net_connect(const char* address, int timeout);
+
+// Sends or receives exactly size bytes. Returns 1 on success and 0 if the connection failed
+// or was closed
+int         net_send(NetSocket* sock, const void* buf, size_t size);
+int         net_recv(NetSocket* sock, void* buf, size_t size);
+
+// Closes the socket. Closing a listening Unix-domain socket removes its file
+void        net_close(NetSocket* sock);
+
+#endif
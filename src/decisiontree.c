@@ -1,12 +1,20 @@
 #include "decisiontree.h"
 #include <pthread.h>
 #include <bitset.h>
+#include <net.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
 
+// Ordinal and categorical attributes take the values 0, ..., DT_MAX_LEVELS-1
+#define DT_MAX_LEVELS       (1 << 16)
+
+// Class weights up to DT_XLOG2X_SIZE-1 look up n log2 n in a table rather than call log2
+#define DT_XLOG2X_SIZE      (1 << 20)
+
 typedef struct DTNode DTNode;
 
 typedef struct DTNode {
@@ -15,6 +23,9 @@ typedef struct DTNode {
     float base;
     int attr_idx;
     int discrete;
+    int missing_right;
+    int num_categories;
+    uint64_t* categories;
     union {
         int label;
         float avg;
@@ -24,6 +35,7 @@ typedef struct DTNode {
 typedef struct DecisionTree {
     int num_attr;
     char** attr_names;
+    DTEnum* feature_types;
     DTTrainConfig config;
     DTNode* root;
 } DecisionTree;
@@ -39,6 +51,7 @@ static void dtnode_destroy(DTNode* node)
         return;
     dtnode_destroy(node->left);
     dtnode_destroy(node->right);
+    free(node->categories);
     free(node);
 }
 
@@ -68,6 +81,7 @@ DecisionTree* decision_tree_create(int num_attr, const char** attr_names)
     dt->root = NULL;
     dt->config = decision_tree_default_config();
     dt->attr_names = copy_attr_names(num_attr, attr_names);
+    dt->feature_types = NULL;
     return dt;
 }
 
@@ -81,6 +95,18 @@ void decision_tree_set_attr(DecisionTree* dt, int num_attr, const char** attr_na
             free(dt->attr_names[i]);
     free(dt->attr_names); 
     dt->attr_names = copy_attr_names(num_attr, attr_names);
+    free(dt->feature_types);
+    dt->feature_types = NULL;
+}
+
+void decision_tree_set_feature_types(DecisionTree* dt, const DTEnum* feature_types)
+{
+    free(dt->feature_types);
+    dt->feature_types = NULL;
+    if (feature_types == NULL)
+        return;
+    dt->feature_types = malloc(dt->num_attr * sizeof(DTEnum));
+    memcpy(dt->feature_types, feature_types, dt->num_attr * sizeof(DTEnum));
 }
 
 DTTrainConfig decision_tree_default_config(void)
@@ -90,7 +116,13 @@ DTTrainConfig decision_tree_default_config(void)
         .splitter = DT_SPLIT_ENTROPY,
         .min_samples_split = 5,
         .max_depth = 8,
-        .max_num_threads = 1
+        .max_num_threads = 1,
+        .num_random_splits = 0,
+        .feature_sampling = DT_FEATURES_ALL,
+        .max_features = 1,
+        .seed = 0,
+        .growth = DT_GROWTH_DEPTH,
+        .max_leaf_nodes = 0
     };
 }
 
@@ -99,56 +131,182 @@ void decision_tree_config(DecisionTree* dt, DTTrainConfig config)
     dt->config = config;
 }
 
-static int get_attr_idx(int num_attr, int attr_idx, int label_idx)
+// Attributes the trainer reads. Dense attributes are stored feature-major, so the values of
+// one attribute are contiguous and each split search scans memory sequentially. Attributes
+// trained out of core stay row-major where they are and are only read in passes over the rows
+typedef struct {
+    int         num_rows;
+    int         num_attr;
+    DTEnum      type;
+    void*       attr;
+    int         owns_attr;
+    int         row_major;
+    int*        col_ptr;
+    int*        row_idx;
+    float*      col_values;
+} DTData;
+
+typedef struct {
+    float       value;
+    int         label_idx;
+} DTEntry;
+
+static size_t get_attr_idx(int num_labels, int attr_idx, int label_idx)
 {
-    return num_attr * label_idx + attr_idx;
+    return (size_t)num_labels * attr_idx + label_idx;
 }
 
-static int get_num_unique_values(int num_attr, int num_labels, float* attr, int attr_idx, Bitset* bitset)
+static int get_attr_type_size(DTEnum attr_type)
 {
-    int i, j;
-    float value1, value2;
-    int num_unique_values;
+    if (attr_type == DT_ATTR_UINT8)
+        return sizeof(uint8_t);
+    if (attr_type == DT_ATTR_UINT16)
+        return sizeof(uint16_t);
+    return sizeof(float);
+}
 
-    num_unique_values = 0;
-    for (i = 0; i < num_labels; i++) {
-        if (!bitset_isset(bitset, i))
-            continue;
-        value1 = attr[get_attr_idx(num_attr, attr_idx, i)];
-        for (j = 0; j < i; j++) {
-            if (!bitset_isset(bitset, j))
-                continue;
-            value2 = attr[get_attr_idx(num_attr, attr_idx, j)];
-            if (value1 == value2)
-                goto not_unique;
+int decision_tree_attr_type_size(DTEnum attr_type)
+{
+    return get_attr_type_size(attr_type);
+}
+
+static float get_typed_value(DTEnum type, void* attr, size_t idx)
+{
+    if (type == DT_ATTR_UINT8)
+        return ((uint8_t*)attr)[idx];
+    if (type == DT_ATTR_UINT16)
+        return ((uint16_t*)attr)[idx];
+    return ((float*)attr)[idx];
+}
+
+static float get_value(DTData* data, int attr_idx, int label_idx)
+{
+    int lo, hi, mid;
+
+    if (data->row_major)
+        return get_typed_value(data->type, data->attr, (size_t)data->num_attr * label_idx + attr_idx);
+    if (data->attr != NULL)
+        return get_typed_value(data->type, data->attr, get_attr_idx(data->num_rows, attr_idx, label_idx));
+
+    lo = data->col_ptr[attr_idx];
+    hi = data->col_ptr[attr_idx+1];
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (data->row_idx[mid] < label_idx)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < data->col_ptr[attr_idx+1] && data->row_idx[lo] == label_idx)
+        return data->col_values[lo];
+    return 0;
+}
+
+// Copies a row-major matrix into feature-major order in tiles, so both the rows read and the
+// columns written stay in cache. If rows is not NULL, row i of the copy is row rows[i] of attr
+static void* transpose(int num_labels, int num_attr, DTEnum type, void* attr, int* rows)
+{
+    int size = get_attr_type_size(type);
+    char* src = attr;
+    char* dst = malloc((size_t)num_labels * num_attr * size);
+    int tile_row, tile_attr, label_idx, attr_idx;
+    int row_end, attr_end;
+    size_t from, to;
+
+    for (tile_row = 0; tile_row < num_labels; tile_row += 64) {
+        row_end = (tile_row + 64 < num_labels) ? tile_row + 64 : num_labels;
+        for (tile_attr = 0; tile_attr < num_attr; tile_attr += 64) {
+            attr_end = (tile_attr + 64 < num_attr) ? tile_attr + 64 : num_attr;
+            for (label_idx = tile_row; label_idx < row_end; label_idx++) {
+                for (attr_idx = tile_attr; attr_idx < attr_end; attr_idx++) {
+                    from = (size_t)num_attr * ((rows != NULL) ? rows[label_idx] : label_idx) + attr_idx;
+                    to = get_attr_idx(num_labels, attr_idx, label_idx);
+                    if (size == 1)
+                        dst[to] = src[from];
+                    else if (size == 2)
+                        ((uint16_t*)dst)[to] = ((uint16_t*)src)[from];
+                    else
+                        ((float*)dst)[to] = ((float*)src)[from];
+                }
+            }
         }
-        num_unique_values++;
-not_unique:
     }
 
-    return num_unique_values;
+    return dst;
 }
 
-static float* get_unique_values(int num_unique_values, int num_attr, int num_labels, float* attr, int attr_idx, Bitset* bitset)
+static void data_init_dense(DTData* data, int num_labels, int num_attr, DTEnum type, void* attr, int feature_major)
 {
-    int uniq_idx, i, j;
-    float value;
-    float* unique_values = calloc(num_unique_values, sizeof(float));
+    data->num_rows = num_labels;
+    data->num_attr = num_attr;
+    data->type = type;
+    data->owns_attr = !feature_major;
+    data->row_major = 0;
+    data->attr = (feature_major) ? attr : transpose(num_labels, num_attr, type, attr, NULL);
+    data->col_ptr = NULL;
+    data->row_idx = NULL;
+    data->col_values = NULL;
+}
+
+// Transposes the rows into compressed columns so that each attribute's nonzeros can be
+// visited without touching the rows where it is 0. Explicit zeros are dropped
+static void data_init_sparse(DTData* data, int num_labels, int num_attr, int* row_ptr, int* col_idx, float* values)
+{
+    int i, j, attr_idx, pos;
+    int* next;
+
+    data->num_rows = num_labels;
+    data->num_attr = num_attr;
+    data->type = DT_ATTR_FLOAT;
+    data->attr = NULL;
+    data->owns_attr = 0;
+    data->row_major = 0;
+    data->col_ptr = calloc(num_attr + 1, sizeof(int));
+
+    for (j = row_ptr[0]; j < row_ptr[num_labels]; j++)
+        if (values[j] != 0)
+            data->col_ptr[col_idx[j]+1]++;
+    for (attr_idx = 0; attr_idx < num_attr; attr_idx++)
+        data->col_ptr[attr_idx+1] += data->col_ptr[attr_idx];
+
+    data->row_idx = malloc(data->col_ptr[num_attr] * sizeof(int));
+    data->col_values = malloc(data->col_ptr[num_attr] * sizeof(float));
+    next = malloc(num_attr * sizeof(int));
+    memcpy(next, data->col_ptr, num_attr * sizeof(int));
 
-    uniq_idx = 0;
     for (i = 0; i < num_labels; i++) {
-        if (!bitset_isset(bitset, i))
-            continue;
-        value = attr[get_attr_idx(num_attr, attr_idx, i)];
-        for (j = 0; j < uniq_idx; j++) {
-            if (value == unique_values[j])
-                goto not_unique;
+        for (j = row_ptr[i]; j < row_ptr[i+1]; j++) {
+            if (values[j] == 0)
+                continue;
+            pos = next[col_idx[j]]++;
+            data->row_idx[pos] = i;
+            data->col_values[pos] = values[j];
         }
-        unique_values[uniq_idx++] = value;
-not_unique:
     }
 
-    return unique_values;
+    free(next);
+}
+
+static void data_init_rows(DTData* data, int num_labels, int num_attr, DTEnum type, void* attr)
+{
+    data->num_rows = num_labels;
+    data->num_attr = num_attr;
+    data->type = type;
+    data->owns_attr = 0;
+    data->row_major = 1;
+    data->attr = attr;
+    data->col_ptr = NULL;
+    data->row_idx = NULL;
+    data->col_values = NULL;
+}
+
+static void data_destroy(DTData* data)
+{
+    if (data->owns_attr)
+        free(data->attr);
+    free(data->col_ptr);
+    free(data->row_idx);
+    free(data->col_values);
 }
 
 static int get_num_unique_labels(int num_labels, int* labels)
@@ -190,39 +348,82 @@ not_unique:
     return unique_labels;
 }
 
-static int* get_unique_labels_count(int num_unique_labels, int* unique_labels, int num_labels, int* labels, Bitset* bitset)
+// Maps each label to its index in unique_labels so counting a label is a single array access
+static int* get_label_ids(int num_unique_labels, int* unique_labels, int num_labels, int* labels)
 {
     int label_idx, uniq_idx;
-    int* unique_labels_count = calloc(num_unique_labels, sizeof(int));
+    int* label_ids = malloc(num_labels * sizeof(int));
 
     for (label_idx = 0; label_idx < num_labels; label_idx++) {
-        if (!bitset_isset(bitset, label_idx))
-            continue;
         for (uniq_idx = 0; uniq_idx < num_unique_labels; uniq_idx++) {
             if (labels[label_idx] == unique_labels[uniq_idx]) {
-                unique_labels_count[uniq_idx]++;
+                label_ids[label_idx] = uniq_idx;
                 break;
             }
         }
     }
 
-    return unique_labels_count;
+    return label_ids;
 }
 
-typedef struct {
+typedef struct DTBins DTBins;
+
+// Rows prepared once for any number of trainings. Each float attribute's rows are kept in
+// increasing order of value, ties in row order, so split searches filter that order by the
+// node's rows instead of sorting them. Integer attributes are already bucketed by counting. The
+// bins of level-wise growth are built by the first unweighted training that needs them, under
+// mutex
+typedef struct DTDataset {
+    DTEnum              type;
+    DTData              data;
+    void*               labels;
+    int                 num_unique_labels;
+    int*                unique_labels;
+    int*                label_ids;
+    int*                order;
+    DTBins*             bins;
+    pthread_mutex_t     mutex;
+} DTDataset;
+
+typedef struct DTTrainParams DTTrainParams;
+
+// Searches the buckets of an attribute in order for a split scoring below best_score. Returns
+// the position of the last bucket on the left, or -1 if none scores below. See get_kernel
+typedef int (*DTSweepBuckets)(DTTrainParams* params, double* node_stats, double* bucket_stats, double* missing_stats, DTEntry* order, int num_buckets, int discrete, double* scores, double* stats_left, double* stats_right, double* stats_below, float* best_score, int* best_missing_right);
+
+// Same for the bins first_bin, ..., last_bin of a histogram. Returns the bin of the best split
+typedef int (*DTSweepBins)(DTTrainParams* params, double* node_stats, double* hist, int first_bin, int last_bin, int discrete, double* stats_left, double* stats_right, float* best_score);
+
+// Adds the row label_idx to stats. See add_stats
+typedef void (*DTAddStats)(DTTrainParams* params, double* stats, int label_idx);
+
+// Puts the value of an attribute for each row of bitset in entries. Returns the number of rows
+typedef int (*DTGather)(DTData* data, int attr_idx, Bitset* bitset, DTEntry* entries);
+
+// Sends the rows of bitset to the side of the split node. See split
+typedef void (*DTPartition)(DTData* data, DTNode* node, Bitset* bitset, Bitset* bitset_left, Bitset* bitset_right);
+
+typedef struct DTTrainParams {
     DTTrainConfig*      config;
-    int                 num_labels;
+    DTData*             data;
+    DTDataset*          dataset;
     int*                labels;
+    int*                label_ids;
     int                 num_unique_labels;
     int*                unique_labels;
-    int                 num_attr;
-    float*              attr;
-    int                 attr_idx;
-    int                 discrete;
-    float               base;
+    int                 num_stats;
+    float*              weights;
+    double*             xlog2x;
+    int                 xlog2x_size;
+    DTEnum*             feature_types;
+    DTSweepBuckets      sweep_buckets;
+    DTSweepBins         sweep_bins;
+    DTAddStats          add_stats;
+    DTGather            gather;
+    DTPartition         partition;
+    int                 max_features;
+    uint64_t            rng;
     Bitset*             bitset;
-    Bitset**            bitset_left;
-    Bitset**            bitset_right;
     int                 depth;
     int*                num_threads_ptr;
     pthread_mutex_t*    num_threads_mutex;
@@ -239,461 +440,3898 @@ static int cmp_continuous(float base, float test)
     return test > base;
 }
 
-static void split(DTTrainParams* params)
+static int cmp_category(DTNode* node, float value)
+{
+    int category;
+
+    if (!(value >= 0 && value < node->num_categories))
+        return 0;
+    category = value;
+    return (node->categories[category / 64] >> (category % 64)) & 1;
+}
+
+// Returns whether a row with value goes to the right child of a split node. Missing values
+// go the way the node learned for them, and categorical splits send the categories in their
+// bitmask right
+static int dtnode_goes_right(DTNode* node, float value)
+{
+    if (isnan(value))
+        return node->missing_right;
+    if (node->categories != NULL)
+        return cmp_category(node, value);
+    if (node->discrete)
+        return cmp_discrete(node->base, value);
+    return cmp_continuous(node->base, value);
+}
+
+#define DT_PARTITION_LOOP(goes_right)                                                               \
+    for (label_idx = 0; label_idx < data->num_rows; label_idx++) {                                  \
+        if (!bitset_isset(bitset, label_idx))                                                       \
+            continue;                                                                               \
+        value = column[stride * label_idx];                                                         \
+        if (goes_right)                                                                             \
+            bitset_set(bitset_right, label_idx);                                                    \
+        else                                                                                        \
+            bitset_set(bitset_left, label_idx);                                                     \
+    }
+
+// Defines the kernels that read a dense attribute of one type and layout straight from its
+// array, gather_name and partition_name, so the loops over a node's rows do not dispatch on
+// either per value. Each kind of split node is partitioned by a loop of its own
+#define DT_DEFINE_COLUMN_KERNELS(name, type, row_major)                                             \
+static int gather_##name(DTData* data, int attr_idx, Bitset* bitset, DTEntry* entries)              \
+{                                                                                                   \
+    size_t  stride  = (row_major) ? (size_t)data->num_attr : 1;                                     \
+    type*   column  = (type*)data->attr + ((row_major) ? (size_t)attr_idx : get_attr_idx(data->num_rows, attr_idx, 0)); \
+                                                                                                    \
+    int label_idx, num_entries;                                                                     \
+                                                                                                    \
+    num_entries = 0;                                                                                \
+    for (label_idx = 0; label_idx < data->num_rows; label_idx++) {                                  \
+        if (!bitset_isset(bitset, label_idx))                                                       \
+            continue;                                                                               \
+        entries[num_entries].value = column[stride * label_idx];                                    \
+        entries[num_entries].label_idx = label_idx;                                                 \
+        num_entries++;                                                                              \
+    }                                                                                               \
+                                                                                                    \
+    return num_entries;                                                                             \
+}                                                                                                   \
+                                                                                                    \
+static void partition_##name(DTData* data, DTNode* node, Bitset* bitset, Bitset* bitset_left,      \
+        Bitset* bitset_right)                                                                       \
+{                                                                                                   \
+    size_t  stride  = (row_major) ? (size_t)data->num_attr : 1;                                     \
+    type*   column  = (type*)data->attr + ((row_major) ? (size_t)node->attr_idx : get_attr_idx(data->num_rows, node->attr_idx, 0)); \
+                                                                                                    \
+    int label_idx;                                                                                  \
+    float value;                                                                                    \
+                                                                                                    \
+    if (node->categories != NULL) {                                                                 \
+        DT_PARTITION_LOOP(isnan(value) ? node->missing_right : cmp_category(node, value))           \
+    } else if (node->discrete) {                                                                    \
+        DT_PARTITION_LOOP(isnan(value) ? node->missing_right : cmp_discrete(node->base, value))     \
+    } else {                                                                                        \
+        DT_PARTITION_LOOP(isnan(value) ? node->missing_right : cmp_continuous(node->base, value))   \
+    }                                                                                               \
+}
+
+DT_DEFINE_COLUMN_KERNELS(float, float, 0)
+DT_DEFINE_COLUMN_KERNELS(uint8, uint8_t, 0)
+DT_DEFINE_COLUMN_KERNELS(uint16, uint16_t, 0)
+DT_DEFINE_COLUMN_KERNELS(float_rows, float, 1)
+DT_DEFINE_COLUMN_KERNELS(uint8_rows, uint8_t, 1)
+DT_DEFINE_COLUMN_KERNELS(uint16_rows, uint16_t, 1)
+
+// Sends the rows of params->bitset to the side of the split node
+static void split(DTTrainParams* params, DTNode* node, Bitset* bitset_left, Bitset* bitset_right)
 {
-    int        discrete      = params->discrete;
-    int        num_labels    = params->num_labels;
-    int        num_attr      = params->num_attr;
-    int        attr_idx      = params->attr_idx;
-    float*     attr          = params->attr;
-    float      base          = params->base;
+    DTData*    data          = params->data;
     Bitset*    bitset        = params->bitset;
-    Bitset**   bitset_left   = params->bitset_left;
-    Bitset**   bitset_right  = params->bitset_right;
-    
-    int (*cmp)(float, float);
-    cmp = (discrete) ? cmp_discrete : cmp_continuous;
+    int        num_labels    = data->num_rows;
+    int        attr_idx      = node->attr_idx;
 
-    float value;
-    int label_idx;
+    int label_idx, k, zero_right;
 
+    if (data->attr != NULL) {
+        params->partition(data, node, bitset, bitset_left, bitset_right);
+        return;
+    }
+
+    // every row starts on the side of 0, then the nonzeros of the column are moved over
+    zero_right = dtnode_goes_right(node, 0);
     for (label_idx = 0; label_idx < num_labels; label_idx++) {
         if (!bitset_isset(bitset, label_idx))
             continue;
-        value = attr[get_attr_idx(num_attr, attr_idx, label_idx)];
-        if (cmp(base, value))
-            bitset_set(*bitset_right, label_idx);
+        if (zero_right)
+            bitset_set(bitset_right, label_idx);
         else
-            bitset_set(*bitset_left, label_idx);
+            bitset_set(bitset_left, label_idx);
+    }
+    for (k = data->col_ptr[attr_idx]; k < data->col_ptr[attr_idx+1]; k++) {
+        label_idx = data->row_idx[k];
+        if (!bitset_isset(bitset, label_idx))
+            continue;
+        if (dtnode_goes_right(node, data->col_values[k]) == zero_right)
+            continue;
+        if (zero_right) {
+            bitset_unset(bitset_right, label_idx);
+            bitset_set(bitset_left, label_idx);
+        } else {
+            bitset_unset(bitset_left, label_idx);
+            bitset_set(bitset_right, label_idx);
+        }
     }
 }
 
-static float calculate_entropy(float res, float p)
+// Sufficient statistics of a set of rows. stats[0] is the total weight of the rows, followed
+// by the weight of each unique label for classifiers, or the weighted sum and sum of squares
+// of the labels for regressors. add_stats_name adds a row for one tree type, with or without
+// weights, and set_kernel picks the one a training uses
+#define DT_DEFINE_ADD_STATS(name, row_weight, classifier)                                           \
+static void add_stats_##name(DTTrainParams* params, double* stats, int label_idx)                  \
+{                                                                                                   \
+    float value, weight;                                                                            \
+                                                                                                    \
+    weight = (row_weight);                                                                          \
+    stats[0] += weight;                                                                             \
+    if (classifier) {                                                                               \
+        stats[1 + params->label_ids[label_idx]] += weight;                                          \
+    } else {                                                                                        \
+        value = ((float*)params->labels)[label_idx];                                                \
+        stats[1] += (double)weight * value;                                                         \
+        stats[2] += (double)weight * value * value;                                                 \
+    }                                                                                               \
+}
+
+DT_DEFINE_ADD_STATS(classifier, 1, 1)
+DT_DEFINE_ADD_STATS(weighted_classifier, params->weights[label_idx], 1)
+DT_DEFINE_ADD_STATS(regressor, 1, 0)
+DT_DEFINE_ADD_STATS(weighted_regressor, params->weights[label_idx], 0)
+
+// splitmix64. Each node draws from its own state, derived from its parent's, so the
+// attributes chosen do not depend on how nodes are spread over threads
+static uint64_t rng_next(uint64_t* state)
 {
-    return res - p * log2(p);
+    uint64_t z = (*state += 0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
 }
 
-static float calculate_gini(float res, float p)
+uint64_t decision_tree_rng_next(uint64_t* state)
 {
-    return res - p * p;
+    return rng_next(state);
 }
 
-static float calculate_error(float res, float p)
+static double* get_node_stats(DTTrainParams* params)
 {
-    return (res > 1 - p) ? res : 1 - p;
+    int label_idx;
+    double* stats = calloc(params->num_stats, sizeof(double));
+
+    for (label_idx = 0; label_idx < params->data->num_rows; label_idx++)
+        if (bitset_isset(params->bitset, label_idx))
+            params->add_stats(params, stats, label_idx);
+
+    return stats;
 }
 
-static float calculate_split_classifier(DTTrainParams* params, Bitset* bitset)
+// Table of n log2 n for the integer weights 0, ..., size-1, which the class weights are
+// unless the rows have fractional weights
+static double* xlog2x_create(int size)
 {
-    DTTrainConfig*  config              = params->config;
-    int             num_unique_labels   = params->num_unique_labels;
-    int*            unique_labels       = params->unique_labels;
-    int             num_labels          = params->num_labels;
-    int*            labels              = params->labels;
+    double* table = malloc(size * sizeof(double));
+    int n;
 
-    float res, p;
-    int n, uniq_idx;
-    int* unique_labels_count;
-    float (*calculate)(float, float);
+    table[0] = 0;
+    for (n = 1; n < size; n++)
+        table[n] = n * log2(n);
+    return table;
+}
 
-    n = bitset_numset(bitset);
-    if (n == 0)
+static double xlog2x(DTTrainParams* params, double x)
+{
+    int n = x;
+    if (n == x && n < params->xlog2x_size)
+        return params->xlog2x[n];
+    return (x > 0) ? x * log2(x) : 0;
+}
+
+// Impurity of a side of a split times its weight n, from the class weights c of its rows. With
+// p = c / n this is n log2 n - sum c log2 c for entropy, -sum c^2 / n for gini, which leaves out
+// the constant 1, and n - c for the least common class present for error. The weighted score
+// of a split is then the sum of its sides over the node's weight, with no division per class
+static double weighted_entropy(DTTrainParams* params, double* stats)
+{
+    int     num_unique_labels   = params->num_unique_labels;
+
+    double res;
+    int uniq_idx;
+
+    if (stats[0] == 0)
         return 0;
 
-    unique_labels_count = get_unique_labels_count(num_unique_labels, unique_labels, num_labels, labels, bitset);
+    res = xlog2x(params, stats[0]);
+    for (uniq_idx = 0; uniq_idx < num_unique_labels; uniq_idx++)
+        res -= xlog2x(params, stats[1 + uniq_idx]);
+    return res;
+}
 
-    if (config->splitter == DT_SPLIT_ENTROPY)
-        calculate = calculate_entropy;
-    else if (config->splitter == DT_SPLIT_GINI)
-        calculate = calculate_gini;
-    else
-        calculate = calculate_error;
+static double weighted_gini(DTTrainParams* params, double* stats)
+{
+    int     num_unique_labels   = params->num_unique_labels;
 
-    res = 0;
-    for (uniq_idx = 0; uniq_idx < num_unique_labels; uniq_idx++) {
-        if (unique_labels_count[uniq_idx] == 0)
-            continue;
-        p = (float)unique_labels_count[uniq_idx] / n;
-        res = calculate(res, p);
-    }
+    double res;
+    int uniq_idx;
 
-    free(unique_labels_count);
+    if (stats[0] == 0)
+        return 0;
 
-    return res;
+    res = 0;
+    for (uniq_idx = 0; uniq_idx < num_unique_labels; uniq_idx++)
+        res += stats[1 + uniq_idx] * stats[1 + uniq_idx];
+    return -res / stats[0];
 }
 
-static float calculate_mse(float res, float val)
+static double weighted_error(DTTrainParams* params, double* stats)
 {
-    return res + val * val;
+    int     num_unique_labels   = params->num_unique_labels;
+
+    double res, c;
+    int uniq_idx;
+
+    if (stats[0] == 0)
+        return 0;
+
+    res = stats[0];
+    for (uniq_idx = 0; uniq_idx < num_unique_labels; uniq_idx++) {
+        c = stats[1 + uniq_idx];
+        if (c > 0 && c < res)
+            res = c;
+    }
+    return stats[0] - res;
 }
 
-static float calculate_abs_error(float res, float val)
+static double calculate_weighted_classifier(DTTrainParams* params, double* stats)
 {
-    return res + val;
+    switch (params->config->splitter) {
+    case DT_SPLIT_ENTROPY:
+        return weighted_entropy(params, stats);
+    case DT_SPLIT_GINI:
+        return weighted_gini(params, stats);
+    default:
+        return weighted_error(params, stats);
+    }
 }
 
-static float calculate_split_regressor(DTTrainParams* params, Bitset* bitset)
+static float calculate_split_classifier(DTTrainParams* params, double* stats)
 {
-    DTTrainConfig*  config  = params->config;
-    int     num_labels      = params->num_labels;
-    float*  labels          = (float*)params->labels;
+    if (stats[0] == 0)
+        return 0;
+    return calculate_weighted_classifier(params, stats) / stats[0];
+}
 
-    float avg, res, val;
-    int n, label_idx;
-    float (*calculate)(float, float);
+static float calculate_split_mse(double* stats)
+{
+    double avg, res;
 
-    n = bitset_numset(bitset);
-    if (n == 0)
+    if (stats[0] == 0)
         return 0;
 
-    if (config->splitter == DT_SPLIT_MSE)
-        calculate = calculate_mse;
-    else
-        calculate = calculate_abs_error;
+    avg = stats[1] / stats[0];
+    res = stats[2] / stats[0] - avg * avg;
 
-    res = 0;
-    for (label_idx = 0; label_idx < num_labels; label_idx++) {
-        if (!bitset_isset(bitset, label_idx))
-            continue;
-        res += labels[label_idx];
+    return (res > 0) ? res : 0;
+}
+
+// A weighted label
+typedef struct {
+    float       value;
+    float       weight;
+} DTWeighted;
+
+// Running weighted median of the labels added so far. low is a max-heap of the lower labels
+// with the median on top and high a min-heap of the rest. The absolute deviation from the
+// median follows from the weight and weighted sum of each half, so each label costs O(log n)
+typedef struct {
+    DTWeighted* low;
+    DTWeighted* high;
+    int         num_low;
+    int         num_high;
+    double      weight_low;
+    double      weight_high;
+    double      sum_low;
+    double      sum_high;
+} DTMedian;
+
+static void median_init(DTMedian* median, int capacity)
+{
+    median->low = malloc(capacity * sizeof(DTWeighted));
+    median->high = malloc(capacity * sizeof(DTWeighted));
+}
+
+static void median_clear(DTMedian* median)
+{
+    median->num_low = median->num_high = 0;
+    median->weight_low = median->weight_high = 0;
+    median->sum_low = median->sum_high = 0;
+}
+
+static void median_destroy(DTMedian* median)
+{
+    free(median->low);
+    free(median->high);
+}
+
+// Heaps are ordered by sign * value, so sign 1 makes a min-heap and -1 a max-heap
+static void median_push(DTWeighted* heap, int* heap_size, DTWeighted item, int sign)
+{
+    int i = (*heap_size)++;
+    while (i > 0 && sign * item.value < sign * heap[(i-1)/2].value) {
+        heap[i] = heap[(i-1)/2];
+        i = (i-1)/2;
     }
-    avg = res / n;
-    res = 0;
-    for (label_idx = 0; label_idx < num_labels; label_idx++) {
-        if (!bitset_isset(bitset, label_idx))
-            continue;
-        val = fabsf(labels[label_idx] - avg);
-        res = calculate(res, val);
+    heap[i] = item;
+}
+
+static DTWeighted median_pop(DTWeighted* heap, int* heap_size, int sign)
+{
+    DTWeighted top, last;
+    int i, child;
+
+    top = heap[0];
+    last = heap[--(*heap_size)];
+    i = 0;
+    while (1) {
+        child = 2*i + 1;
+        if (child >= *heap_size)
+            break;
+        if (child + 1 < *heap_size && sign * heap[child+1].value < sign * heap[child].value)
+            child++;
+        if (!(sign * heap[child].value < sign * last.value))
+            break;
+        heap[i] = heap[child];
+        i = child;
     }
-    res /= n;
+    heap[i] = last;
 
-    return res;
+    return top;
 }
 
-static int all_labels_equal(int num_labels, int* labels, Bitset* bitset)
+// Keeps the median on top of low: the labels below it weigh less than half of the total,
+// and with it at least half
+static void median_add(DTMedian* median, float value, float weight)
 {
-    int i, base = -1;
-    for (i = 0; i < num_labels; i++) {
-        if (bitset_isset(bitset, i)) {
-            base = labels[i];
-            break;
-        }
+    DTWeighted item = { value, weight };
+    double half;
+
+    if (median->num_low == 0 || value <= median->low[0].value) {
+        median_push(median->low, &median->num_low, item, -1);
+        median->weight_low += weight;
+        median->sum_low += (double)weight * value;
+    } else {
+        median_push(median->high, &median->num_high, item, 1);
+        median->weight_high += weight;
+        median->sum_high += (double)weight * value;
     }
-    while (i < num_labels) {
-        if (bitset_isset(bitset, i) && labels[i] != base)
-            return 0;
-        i++;
+
+    half = (median->weight_low + median->weight_high) / 2;
+    while (median->num_low > 1 && median->weight_low - median->low[0].weight >= half) {
+        item = median_pop(median->low, &median->num_low, -1);
+        median_push(median->high, &median->num_high, item, 1);
+        median->weight_low -= item.weight;
+        median->sum_low -= (double)item.weight * item.value;
+        median->weight_high += item.weight;
+        median->sum_high += (double)item.weight * item.value;
+    }
+    while (median->num_high > 0 && median->weight_low < half) {
+        item = median_pop(median->high, &median->num_high, 1);
+        median_push(median->low, &median->num_low, item, -1);
+        median->weight_high -= item.weight;
+        median->sum_high -= (double)item.weight * item.value;
+        median->weight_low += item.weight;
+        median->sum_low += (double)item.weight * item.value;
     }
-    return 1;
 }
 
-static int get_most_common_label(int num_unique_labels, int* unique_labels, int num_labels, int* labels, Bitset* bitset)
+static float median_value(DTMedian* median)
 {
-    int i, j, most_common_idx, most_common;
-    if (num_unique_labels == 0)
-        return -1;
-    int* unique_labels_count = calloc(num_unique_labels, sizeof(int));
+    return (median->num_low == 0) ? 0 : median->low[0].value;
+}
 
-    for (i = 0; i < num_labels; i++) {
-        if (!bitset_isset(bitset, i))
-            continue;
-        for (j = 0; j < num_unique_labels; j++) {
-            if (labels[i] == unique_labels[j]) {
-                unique_labels_count[j]++;
-                break;
-            }
-        }
-    }
+// Total weighted absolute deviation from the median
+static double median_abs_error(DTMedian* median)
+{
+    double value = median_value(median);
+    double res = value * median->weight_low - median->sum_low + median->sum_high - value * median->weight_high;
+    return (res > 0) ? res : 0;
+}
 
-    most_common_idx = 0;
-    for (i = 1; i < num_unique_labels; i++)
-        if (unique_labels_count[i] > unique_labels_count[most_common_idx])
-            most_common_idx = i;
-    most_common = unique_labels[most_common_idx];
+static void median_add_row(DTTrainParams* params, DTMedian* median, int label_idx)
+{
+    median_add(median, ((float*)params->labels)[label_idx], (params->weights == NULL) ? 1 : params->weights[label_idx]);
+}
 
-    free(unique_labels_count);
+// Adds the labels of the rows rows[begin], ..., rows[end-1]
+static void median_add_rows(DTTrainParams* params, DTMedian* median, int* rows, int begin, int end)
+{
+    int i;
 
-    return most_common;
+    for (i = begin; i < end; i++)
+        median_add_row(params, median, rows[i]);
 }
 
-static float get_labels_average(int num_labels, float* labels, Bitset* bitset)
+// Returns the weighted median of the labels of the rows in params->bitset, and puts their
+// mean absolute deviation from it in abs_error
+static float get_node_median(DTTrainParams* params, float* abs_error)
 {
-    int i, cnt;
-    float avg;
+    DTMedian median;
+    double weight;
+    float value;
+    int label_idx;
 
-    avg = cnt = 0;
-    for (i = 0; i < num_labels; i++) {
-        if (!bitset_isset(bitset, i))
-            continue;
-        avg = (avg * cnt + labels[i]) / (cnt+1);
-        cnt++;
-    }
+    median_init(&median, bitset_numset(params->bitset));
+    median_clear(&median);
+    for (label_idx = 0; label_idx < params->data->num_rows; label_idx++)
+        if (bitset_isset(params->bitset, label_idx))
+            median_add_row(params, &median, label_idx);
+    value = median_value(&median);
+    weight = median.weight_low + median.weight_high;
+    *abs_error = (weight == 0) ? 0 : median_abs_error(&median) / weight;
+    median_destroy(&median);
+
+    return value;
+}
 
-    return avg;
+// The weighted score of a split with the given sides, one per criterion
+static float score_entropy(DTTrainParams* params, double* stats_left, double* stats_right)
+{
+    return (weighted_entropy(params, stats_left) + weighted_entropy(params, stats_right)) / (stats_left[0] + stats_right[0]);
 }
 
-static void* decision_tree_train_helper(void* void_params)
+static float score_gini(DTTrainParams* params, double* stats_left, double* stats_right)
 {
-    DTTrainParams*      params              = void_params;
-    Bitset*             bitset              = params->bitset;
-    DTTrainConfig*      config              = params->config;
-    int                 num_labels          = params->num_labels;
-    int*                labels              = params->labels;
-    int                 num_unique_labels   = params->num_unique_labels;
-    int*                unique_labels       = params->unique_labels;
-    int                 num_attr            = params->num_attr;
-    float*              attr                = params->attr;
-    int                 depth               = params->depth;
-    int*                num_threads_ptr     = params->num_threads_ptr;
-    pthread_mutex_t*    num_threads_mutex   = params->num_threads_mutex;
-
-    if (params->thread_mutex != NULL)
-        pthread_mutex_unlock(params->thread_mutex);
+    return (weighted_gini(params, stats_left) + weighted_gini(params, stats_right)) / (stats_left[0] + stats_right[0]);
+}
 
-    DTNode* node;
-    DTTrainParams* new_params;
-    Bitset* bitset_left;
-    Bitset* bitset_right;
-    float* unique_values;
-    int best_attr_idx, attr_idx;
-    int best_discrete;
-    int uniq_idx, num_unique_values;
-    int n_parent, n_left, n_right;
-    float score, best_score;
+static float score_error(DTTrainParams* params, double* stats_left, double* stats_right)
+{
+    return (weighted_error(params, stats_left) + weighted_error(params, stats_right)) / (stats_left[0] + stats_right[0]);
+}
+
+static float score_mse(DTTrainParams* params, double* stats_left, double* stats_right)
+{
     float score_left, score_right;
-    float best_base;
-    bool classifier_condition;
-    pthread_t thid;
-    void* async_left;
+    double n_left, n_right, n_parent;
 
-    new_params = malloc(sizeof(DTTrainParams));
-    new_params->config = config;
-    new_params->num_labels = num_labels;
-    new_params->labels = labels;
-    new_params->num_unique_labels = num_unique_labels;
-    new_params->unique_labels = unique_labels;
-    new_params->num_attr = num_attr;
-    new_params->attr = attr;
-    new_params->depth = depth + 1;
-    new_params->bitset = bitset;
-    new_params->num_threads_ptr = num_threads_ptr;
-    new_params->num_threads_mutex = num_threads_mutex;
-    new_params->thread_mutex = NULL;
+    (void)params;
+    n_left = stats_left[0];
+    n_right = stats_right[0];
+    n_parent = n_left + n_right;
 
-    node = malloc(sizeof(DTNode));
-    node->left = node->right = NULL;
-    node->base = 0;
-    node->attr_idx = -2;
-    node->discrete = -1;
-    node->label = -1;
+    score_left = calculate_split_mse(stats_left);
+    score_right = calculate_split_mse(stats_right);
 
-    classifier_condition = config->type == DT_CLASSIFIER && all_labels_equal(num_labels, labels, bitset);
-    if (depth >= config->max_depth || classifier_condition) {
-        if (config->type == DT_CLASSIFIER)
-            node->label = get_most_common_label(num_unique_labels, unique_labels, num_labels, labels, bitset);
-        else
-            node->avg = get_labels_average(num_labels, (float*)labels, bitset);
-        return node;
-    }
+    return ((float)(n_left / n_parent)) * score_left + ((float)(n_right / n_parent)) * score_right;
+}
+
+// Defines the split search kernels of a criterion, sweep_buckets_name and sweep_bins_name,
+// with its score inlined into the loops. Continuous attributes are split after each bucket
+// but the last and discrete ones on each bucket against the rest. Rows missing the attribute
+// are tried on the left and then on the right
+#define DT_DEFINE_KERNELS(name, score)                                                              \
+static int sweep_buckets_##name(DTTrainParams* params, double* node_stats, double* bucket_stats,    \
+        double* missing_stats, DTEntry* order, int num_buckets, int discrete, double* scores,      \
+        double* stats_left, double* stats_right, double* stats_below, float* best_score,            \
+        int* best_missing_right)                                                                    \
+{                                                                                                   \
+    int num_stats = params->num_stats;                                                              \
+    int has_missing = missing_stats[0] > 0;                                                         \
+                                                                                                    \
+    double* stats;                                                                                  \
+    int pos, best_pos, missing_right, j;                                                            \
+    float res;                                                                                      \
+                                                                                                    \
+    (void)scores;                                                                                   \
+    /* every bucket holds at least one row, so both sides have rows unless there is one bucket */  \
+    if (num_buckets <= 1)                                                                           \
+        return -1;                                                                                  \
+                                                                                                    \
+    best_pos = -1;                                                                                  \
+    memset(stats_below, 0, num_stats * sizeof(double));                                             \
+    for (pos = 0; pos < num_buckets; pos++) {                                                       \
+        stats = bucket_stats + order[pos].label_idx * num_stats;                                    \
+        for (j = 0; j < num_stats; j++)                                                             \
+            stats_below[j] += stats[j];                                                             \
+        if (!discrete && pos == num_buckets - 1)                                                    \
+            break;                                                                                  \
+        for (missing_right = 0; missing_right <= has_missing; missing_right++) {                    \
+            if (discrete) {                                                                         \
+                for (j = 0; j < num_stats; j++) {                                                   \
+                    stats_right[j] = stats[j] + ((missing_right) ? missing_stats[j] : 0);           \
+                    stats_left[j] = node_stats[j] - stats_right[j];                                 \
+                }                                                                                   \
+            } else {                                                                                \
+                for (j = 0; j < num_stats; j++) {                                                   \
+                    stats_left[j] = stats_below[j] + ((missing_right) ? 0 : missing_stats[j]);      \
+                    stats_right[j] = node_stats[j] - stats_left[j];                                 \
+                }                                                                                   \
+            }                                                                                       \
+            res = score(params, stats_left, stats_right);                                           \
+            if (res < *best_score) {                                                                \
+                *best_score = res;                                                                  \
+                *best_missing_right = missing_right;                                                \
+                best_pos = pos;                                                                     \
+            }                                                                                       \
+        }                                                                                           \
+    }                                                                                               \
+                                                                                                    \
+    return best_pos;                                                                                \
+}                                                                                                   \
+                                                                                                    \
+static int sweep_bins_##name(DTTrainParams* params, double* node_stats, double* hist, int first_bin, \
+        int last_bin, int discrete, double* stats_left, double* stats_right, float* best_score)     \
+{                                                                                                   \
+    int num_stats = params->num_stats;                                                              \
+                                                                                                    \
+    double* stats;                                                                                  \
+    int bin, best_bin, j;                                                                           \
+    float res;                                                                                      \
+                                                                                                    \
+    best_bin = -1;                                                                                  \
+    memset(stats_left, 0, num_stats * sizeof(double));                                              \
+    for (bin = first_bin; bin <= last_bin; bin++) {                                                 \
+        stats = hist + bin * num_stats;                                                             \
+        if (stats[0] == 0)                                                                          \
+            continue;                                                                               \
+        if (discrete) {                                                                             \
+            for (j = 0; j < num_stats; j++) {                                                       \
+                stats_right[j] = stats[j];                                                          \
+                stats_left[j] = node_stats[j] - stats[j];                                           \
+            }                                                                                       \
+        } else {                                                                                    \
+            if (bin == last_bin)                                                                    \
+                continue;                                                                           \
+            for (j = 0; j < num_stats; j++) {                                                       \
+                stats_left[j] += stats[j];                                                          \
+                stats_right[j] = node_stats[j] - stats_left[j];                                     \
+            }                                                                                       \
+        }                                                                                           \
+        res = score(params, stats_left, stats_right);                                               \
+        if (res < *best_score) {                                                                    \
+            *best_score = res;                                                                      \
+            best_bin = bin;                                                                         \
+        }                                                                                           \
+    }                                                                                               \
+                                                                                                    \
+    return best_bin;                                                                                \
+}
 
-    bitset_left = bitset_create(num_labels);
-    bitset_right = bitset_create(num_labels);
-    new_params->bitset_left = &bitset_left;
-    new_params->bitset_right = &bitset_right;
+DT_DEFINE_KERNELS(entropy, score_entropy)
+DT_DEFINE_KERNELS(gini, score_gini)
+DT_DEFINE_KERNELS(error, score_error)
+DT_DEFINE_KERNELS(mse, score_mse)
 
-    best_score = 1e9;
-    best_attr_idx = -1;
-    best_base = -1;
-    best_discrete = -1;
+// Absolute error splits are scored ahead by get_abs_error_scores, which puts the score of the
+// split after position pos with missing rows on side missing_right in scores[2 * pos + missing_right]
+static int sweep_buckets_abs_error(DTTrainParams* params, double* node_stats, double* bucket_stats, double* missing_stats, DTEntry* order, int num_buckets, int discrete, double* scores, double* stats_left, double* stats_right, double* stats_below, float* best_score, int* best_missing_right)
+{
+    int has_missing = missing_stats[0] > 0;
 
-    for (attr_idx = 0; attr_idx < num_attr; attr_idx++) {
-        num_unique_values = get_num_unique_values(num_attr, num_labels, attr, attr_idx, bitset);
-        unique_values = get_unique_values(num_unique_values, num_attr, num_labels, attr, attr_idx, bitset);
-        n_parent = bitset_numset(bitset);
-        new_params->discrete = num_unique_values <= config->min_samples_split;
-        new_params->attr_idx = attr_idx;
-        for (uniq_idx = 0; uniq_idx < num_unique_values; uniq_idx++) {
-            new_params->base = unique_values[uniq_idx];
-            bitset_unsetall(bitset_left);
-            bitset_unsetall(bitset_right);
-            split(new_params);
-            n_left = bitset_numset(bitset_left);
-            n_right = bitset_numset(bitset_right);
-            if (n_left == 0 || n_right == 0)
-                continue;
-            if (config->type == DT_CLASSIFIER) {
-                score_left = calculate_split_classifier(new_params, bitset_left);
-                score_right = calculate_split_classifier(new_params, bitset_right);
-                score = (
-                            ((float)n_left  / n_parent) * score_left
-                        +   ((float)n_right / n_parent) * score_right
-                );
-                if (score < best_score) {
-                    best_score = score;
-                    best_attr_idx = new_params->attr_idx;
-                    best_base = new_params->base;
-                    best_discrete = new_params->discrete;
-                }
-            } else if (config->type == DT_REGRESSOR) {
-                score_left = calculate_split_regressor(new_params, bitset_left);
-                score_right = calculate_split_regressor(new_params, bitset_right);
-                score = (
-                            ((float)n_left  / n_parent) * score_left
-                        +   ((float)n_right / n_parent) * score_right
-                );
-                if (score < best_score) {
-                    best_score = score;
-                    best_attr_idx = new_params->attr_idx;
-                    best_base = new_params->base;
-                    best_discrete = new_params->discrete;
-                }
+    int pos, best_pos, missing_right;
+    float res;
+
+    (void)params; (void)node_stats; (void)bucket_stats; (void)order;
+    (void)stats_left; (void)stats_right; (void)stats_below;
+    if (num_buckets <= 1)
+        return -1;
+
+    best_pos = -1;
+    for (pos = 0; pos < num_buckets; pos++) {
+        if (!discrete && pos == num_buckets - 1)
+            break;
+        for (missing_right = 0; missing_right <= has_missing; missing_right++) {
+            res = scores[2 * pos + missing_right];
+            if (res < *best_score) {
+                *best_score = res;
+                *best_missing_right = missing_right;
+                best_pos = pos;
             }
         }
-        free(unique_values);
     }
 
-    new_params->discrete = best_discrete;
-    new_params->attr_idx = best_attr_idx;
-    new_params->base = best_base;
+    return best_pos;
+}
+
+// Picks the split search kernels of the config's criterion, once per training. Level-wise
+// growth does not support absolute error, so its bins are only ever swept with the others
+// Also picks the kernels that add rows to stats and read params->data, which must be set
+static void set_kernel(DTTrainParams* params, DTTrainConfig* config)
+{
+    if (config->type == DT_REGRESSOR) {
+        params->sweep_buckets = (config->splitter == DT_SPLIT_ABS_ERROR) ? sweep_buckets_abs_error : sweep_buckets_mse;
+        params->sweep_bins = sweep_bins_mse;
+    } else if (config->splitter == DT_SPLIT_ENTROPY) {
+        params->sweep_buckets = sweep_buckets_entropy;
+        params->sweep_bins = sweep_bins_entropy;
+    } else if (config->splitter == DT_SPLIT_GINI) {
+        params->sweep_buckets = sweep_buckets_gini;
+        params->sweep_bins = sweep_bins_gini;
+    } else {
+        params->sweep_buckets = sweep_buckets_error;
+        params->sweep_bins = sweep_bins_error;
+    }
+
+    if (config->type == DT_CLASSIFIER)
+        params->add_stats = (params->weights == NULL) ? add_stats_classifier : add_stats_weighted_classifier;
+    else
+        params->add_stats = (params->weights == NULL) ? add_stats_regressor : add_stats_weighted_regressor;
+
+    if (params->data->row_major && params->data->type == DT_ATTR_UINT8) {
+        params->gather = gather_uint8_rows;
+        params->partition = partition_uint8_rows;
+    } else if (params->data->row_major && params->data->type == DT_ATTR_UINT16) {
+        params->gather = gather_uint16_rows;
+        params->partition = partition_uint16_rows;
+    } else if (params->data->row_major) {
+        params->gather = gather_float_rows;
+        params->partition = partition_float_rows;
+    } else if (params->data->type == DT_ATTR_UINT8) {
+        params->gather = gather_uint8;
+        params->partition = partition_uint8;
+    } else if (params->data->type == DT_ATTR_UINT16) {
+        params->gather = gather_uint16;
+        params->partition = partition_uint16;
+    } else {
+        params->gather = gather_float;
+        params->partition = partition_float;
+    }
+}
 
-    bitset_unsetall(bitset_left);
-    bitset_unsetall(bitset_right);
-    split(new_params);
+static int compare_entries(const void* a, const void* b)
+{
+    float value_a = ((DTEntry*)a)->value;
+    float value_b = ((DTEntry*)b)->value;
+    return (value_a > value_b) - (value_a < value_b);
+}
 
-    node->discrete = best_discrete;
-    node->attr_idx = best_attr_idx;
-    node->base = best_base;
+// Missing values go last
+static int compare_entries_rows(const void* a, const void* b)
+{
+    int res = !isnan(((DTEntry*)b)->value) - !isnan(((DTEntry*)a)->value);
+    if (res != 0)
+        return res;
+    res = compare_entries(a, b);
+    if (res != 0)
+        return res;
+    return ((DTEntry*)a)->label_idx - ((DTEntry*)b)->label_idx;
+}
 
-    n_left = bitset_numset(bitset_left);
-    n_right = bitset_numset(bitset_right);
+// The declared type of an attribute, DT_FEATURE_AUTO if none were declared
+static DTEnum get_feature_type(DTTrainParams* params, int attr_idx)
+{
+    if (params->feature_types == NULL)
+        return DT_FEATURE_AUTO;
+    return params->feature_types[attr_idx];
+}
 
-    new_params->bitset_left = NULL;
-    new_params->bitset_right = NULL;
+// Integer attributes, and ordinal or categorical float attributes, whose values in the node
+// span at most one more value than the node has rows are bucketed by counting the entries
+// into a histogram over that span, which needs no sorting. Returns -1 if the span is too wide
+static int get_buckets_histogram(DTTrainParams* params, DTEntry* entries, int num_entries, float* bucket_values, double* bucket_stats)
+{
+    int num_stats = params->num_stats;
 
-    int num_threads;
-    pthread_mutex_lock(num_threads_mutex);
-    num_threads = *num_threads_ptr;
-    if (num_threads < config->max_num_threads)
-        (*num_threads_ptr)++;
-    pthread_mutex_unlock(num_threads_mutex);
+    int i, value, min_value, max_value, num_buckets;
+
+    min_value = DT_MAX_LEVELS;
+    max_value = -1;
+    for (i = 0; i < num_entries; i++) {
+        value = entries[i].value;
+        min_value = (value < min_value) ? value : min_value;
+        max_value = (value > max_value) ? value : max_value;
+    }
+
+    if (max_value < min_value)
+        return 0;
+    if (max_value - min_value + 1 > num_entries + 1)
+        return -1;
+
+    memset(bucket_stats, 0, (max_value - min_value + 1) * num_stats * sizeof(double));
+    for (i = 0; i < num_entries; i++) {
+        value = entries[i].value;
+        params->add_stats(params, bucket_stats + (value - min_value) * num_stats, entries[i].label_idx);
+    }
+
+    num_buckets = 0;
+    for (value = min_value; value <= max_value; value++) {
+        if (bucket_stats[(value - min_value) * num_stats] == 0)
+            continue;
+        bucket_values[num_buckets] = value;
+        memmove(bucket_stats + num_buckets * num_stats, bucket_stats + (value - min_value) * num_stats, num_stats * sizeof(double));
+        num_buckets++;
+    }
+
+    return num_buckets;
+}
+
+// Groups the values of an attribute in the current node into buckets of equal value sorted
+// in increasing order, each holding the stats of its rows. For sparse data only the nonzeros
+// are visited and the rows that are 0 form one bucket whose stats are whatever the nonzeros
+// leave of the node's stats. Rows whose value is missing are left out of the buckets and their
+// stats are put in missing_stats. Returns the number of buckets
+static int get_buckets(DTTrainParams* params, int attr_idx, double* node_stats, DTEntry* entries, float* bucket_values, double* bucket_stats, double* missing_stats)
+{
+    DTData*     data        = params->data;
+    Bitset*     bitset      = params->bitset;
+    int         num_stats   = params->num_stats;
+
+    int label_idx, k, i, num_entries, num_missing, num_buckets, zero_bucket;
+    int* order;
+    float value;
+    double* stats;
+    double* zero_stats;
+    DTEnum feature_type;
+
+    memset(missing_stats, 0, num_stats * sizeof(double));
+
+    order = NULL;
+    if (params->dataset != NULL && params->dataset->order != NULL)
+        order = params->dataset->order + (size_t)attr_idx * data->num_rows;
+
+    num_entries = 0;
+    num_missing = 0;
+    if (order != NULL) {
+        for (k = 0; k < data->num_rows; k++) {
+            label_idx = order[k];
+            if (!bitset_isset(bitset, label_idx))
+                continue;
+            entries[num_entries].value = get_value(data, attr_idx, label_idx);
+            entries[num_entries].label_idx = label_idx;
+            num_entries++;
+        }
+    } else if (data->attr != NULL) {
+        num_entries = params->gather(data, attr_idx, bitset, entries);
+    } else {
+        for (k = data->col_ptr[attr_idx]; k < data->col_ptr[attr_idx+1]; k++) {
+            label_idx = data->row_idx[k];
+            if (!bitset_isset(bitset, label_idx))
+                continue;
+            entries[num_entries].value = data->col_values[k];
+            entries[num_entries].label_idx = label_idx;
+            num_entries++;
+        }
+    }
+
+    // missing values are sorted last in a dataset's order, and moved out before sorting
+    // otherwise since NaN does not compare
+    for (i = 0; i < num_entries; i++) {
+        value = entries[i].value;
+        if (isnan(value)) {
+            params->add_stats(params, missing_stats, entries[i].label_idx);
+            num_missing++;
+        } else {
+            entries[i - num_missing] = entries[i];
+        }
+    }
+    num_entries -= num_missing;
+
+    feature_type = get_feature_type(params, attr_idx);
+    if (order == NULL && data->attr != NULL && (data->type != DT_ATTR_FLOAT || feature_type == DT_FEATURE_ORDINAL || feature_type == DT_FEATURE_CATEGORICAL)) {
+        num_buckets = get_buckets_histogram(params, entries, num_entries, bucket_values, bucket_stats);
+        if (num_buckets != -1)
+            return num_buckets;
+    }
+
+    if (order == NULL)
+        qsort(entries, num_entries, sizeof(DTEntry), compare_entries);
+
+    zero_bucket = num_entries + num_missing < bitset_numset(bitset);
+    zero_stats = NULL;
+    if (zero_bucket) {
+        zero_stats = calloc(num_stats, sizeof(double));
+        for (i = 0; i < num_entries; i++)
+            params->add_stats(params, zero_stats, entries[i].label_idx);
+        for (i = 0; i < num_stats; i++)
+            zero_stats[i] = node_stats[i] - zero_stats[i] - missing_stats[i];
+    }
+
+    num_buckets = 0;
+    for (i = 0; i <= num_entries; i++) {
+        if (zero_bucket && (i == num_entries || entries[i].value > 0)) {
+            bucket_values[num_buckets] = 0;
+            memcpy(bucket_stats + num_buckets * num_stats, zero_stats, num_stats * sizeof(double));
+            num_buckets++;
+            zero_bucket = 0;
+        }
+        if (i == num_entries)
+            break;
+        if (num_buckets == 0 || entries[i].value != bucket_values[num_buckets-1]) {
+            bucket_values[num_buckets] = entries[i].value;
+            memset(bucket_stats + num_buckets * num_stats, 0, num_stats * sizeof(double));
+            num_buckets++;
+        }
+        stats = bucket_stats + (num_buckets-1) * num_stats;
+        params->add_stats(params, stats, entries[i].label_idx);
+    }
+
+    free(zero_stats);
+
+    return num_buckets;
+}
+
+static int get_threshold_bucket(int num_thresholds, float* thresholds, float value)
+{
+    int lo = 0, hi = num_thresholds, mid;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (thresholds[mid] < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Extremely randomized trees. Instead of a bucket per unique value, num_random_splits
+// thresholds are drawn uniformly between the attribute's min and max in the node and the rows
+// are bucketed between them, so no sorting is needed. Each bucket's value is the threshold
+// above it, and empty buckets are dropped since they would repeat the split before them
+// Rows whose value is missing are left out as in get_buckets. Returns the number of buckets
+static int get_buckets_random(DTTrainParams* params, int attr_idx, double* node_stats, DTEntry* entries, float* bucket_values, double* bucket_stats, double* missing_stats)
+{
+    DTData*     data            = params->data;
+    Bitset*     bitset          = params->bitset;
+    int         num_stats       = params->num_stats;
+    int         num_thresholds  = params->config->num_random_splits;
+
+    int label_idx, k, i, j, num_entries, num_missing, num_buckets, zero_bucket;
+    float value, min_value, max_value;
+    float* thresholds;
+    double* stats;
+
+    num_entries = 0;
+    if (data->attr != NULL) {
+        num_entries = params->gather(data, attr_idx, bitset, entries);
+    } else {
+        for (k = data->col_ptr[attr_idx]; k < data->col_ptr[attr_idx+1]; k++) {
+            label_idx = data->row_idx[k];
+            if (!bitset_isset(bitset, label_idx))
+                continue;
+            entries[num_entries].value = data->col_values[k];
+            entries[num_entries].label_idx = label_idx;
+            num_entries++;
+        }
+    }
+
+    memset(missing_stats, 0, num_stats * sizeof(double));
+    num_missing = 0;
+    for (i = 0; i < num_entries; i++) {
+        if (isnan(entries[i].value)) {
+            params->add_stats(params, missing_stats, entries[i].label_idx);
+            num_missing++;
+        } else {
+            entries[i - num_missing] = entries[i];
+        }
+    }
+    num_entries -= num_missing;
+
+    zero_bucket = num_entries + num_missing < bitset_numset(bitset);
+    min_value = (zero_bucket) ? 0 : INFINITY;
+    max_value = (zero_bucket) ? 0 : -INFINITY;
+    for (i = 0; i < num_entries; i++) {
+        value = entries[i].value;
+        min_value = (value < min_value) ? value : min_value;
+        max_value = (value > max_value) ? value : max_value;
+    }
+
+    if (!(min_value < max_value))
+        return 1;
+
+    thresholds = malloc(num_thresholds * sizeof(float));
+    for (i = 0; i < num_thresholds; i++) {
+        value = min_value + (rng_next(&params->rng) >> 40) * (1.0f / (1 << 24)) * (max_value - min_value);
+        for (j = i; j > 0 && thresholds[j-1] > value; j--)
+            thresholds[j] = thresholds[j-1];
+        thresholds[j] = value;
+    }
+
+    memset(bucket_stats, 0, (num_thresholds + 1) * num_stats * sizeof(double));
+    for (i = 0; i < num_entries; i++) {
+        j = get_threshold_bucket(num_thresholds, thresholds, entries[i].value);
+        params->add_stats(params, bucket_stats + j * num_stats, entries[i].label_idx);
+    }
+
+    // the rows that are 0 get whatever the nonzeros leave of the node's stats
+    if (zero_bucket) {
+        stats = calloc(num_stats, sizeof(double));
+        for (i = 0; i < num_entries; i++)
+            params->add_stats(params, stats, entries[i].label_idx);
+        j = get_threshold_bucket(num_thresholds, thresholds, 0);
+        for (i = 0; i < num_stats; i++)
+            bucket_stats[j * num_stats + i] += node_stats[i] - stats[i] - missing_stats[i];
+        free(stats);
+    }
+
+    num_buckets = 0;
+    for (i = 0; i <= num_thresholds; i++) {
+        if (bucket_stats[i * num_stats] == 0)
+            continue;
+        bucket_values[num_buckets] = (i < num_thresholds) ? thresholds[i] : max_value;
+        memmove(bucket_stats + num_buckets * num_stats, bucket_stats + i * num_stats, num_stats * sizeof(double));
+        num_buckets++;
+    }
+
+    free(thresholds);
+
+    return num_buckets;
+}
+
+// Orders the buckets of a categorical attribute by their mean label, or for classifiers by
+// the frequency of the node's most common label, target
+static float get_category_key(DTTrainParams* params, double* stats, int target)
+{
+    if (params->config->type == DT_CLASSIFIER)
+        return stats[1 + target] / stats[0];
+    return stats[1] / stats[0];
+}
+
+// Sets the categories of a categorical split to the values of the buckets order[start], ...,
+// order[num_buckets-1], which go right
+static void set_categories(DTNode* node, DTEntry* order, int start, int num_buckets, float* bucket_values)
+{
+    int pos, category, max_category;
+
+    max_category = 0;
+    for (pos = 0; pos < num_buckets; pos++)
+        if (bucket_values[pos] > max_category)
+            max_category = bucket_values[pos];
+
+    free(node->categories);
+    node->num_categories = max_category + 1;
+    node->categories = calloc((node->num_categories + 63) / 64, sizeof(uint64_t));
+    for (pos = start; pos < num_buckets; pos++) {
+        category = bucket_values[order[pos].label_idx];
+        node->categories[category / 64] |= (uint64_t)1 << (category % 64);
+    }
+}
+
+// Scores every split of an attribute in the current node by the weighted absolute deviation of
+// each side from its own median, over the node's weight. scores[2*pos + missing_right] is the
+// split at the bucket order[pos], with the missing rows on the right if missing_right is set
+// Threshold and categorical splits put a prefix of the order on the left, so one sweep adding
+// the buckets from the left and one from the right score them all in O(n log n). Discrete
+// attributes have few buckets and each split is scored on its own
+static void get_abs_error_scores(DTTrainParams* params, int attr_idx, double* node_stats, int num_buckets, float* bucket_values, DTEntry* order, int discrete, double* scores)
+{
+    DTData*     data        = params->data;
+    Bitset*     bitset      = params->bitset;
+
+    DTMedian median;
+    float value;
+    int* node_rows;
+    int* row_pos;
+    int* pos_of;
+    int* start;
+    int* rows;
+    int label_idx, pos, other, missing_right, has_missing, i, n;
+
+    n = bitset_numset(bitset);
+    node_rows = malloc(n * sizeof(int));
+    row_pos = malloc(n * sizeof(int));
+    pos_of = malloc(num_buckets * sizeof(int));
+    start = calloc(num_buckets + 2, sizeof(int));
+    rows = malloc(n * sizeof(int));
+    for (pos = 0; pos < num_buckets; pos++)
+        pos_of[order[pos].label_idx] = pos;
+
+    // the rows are grouped by the position of their bucket, which for a row is the first
+    // bucket whose value is at least its own, and the missing rows come last
+    i = 0;
+    for (label_idx = 0; label_idx < data->num_rows; label_idx++) {
+        if (!bitset_isset(bitset, label_idx))
+            continue;
+        value = get_value(data, attr_idx, label_idx);
+        node_rows[i] = label_idx;
+        row_pos[i] = isnan(value) ? num_buckets : pos_of[get_threshold_bucket(num_buckets, bucket_values, value)];
+        start[row_pos[i] + 1]++;
+        i++;
+    }
+    for (pos = 0; pos <= num_buckets; pos++)
+        start[pos + 1] += start[pos];
+    for (i = 0; i < n; i++)
+        rows[start[row_pos[i]]++] = node_rows[i];
+    for (pos = num_buckets; pos > 0; pos--)
+        start[pos] = start[pos - 1];
+    start[0] = 0;
+    has_missing = start[num_buckets] < n;
+
+    median_init(&median, n);
+    for (missing_right = 0; missing_right <= has_missing; missing_right++) {
+        if (discrete) {
+            for (pos = 0; pos < num_buckets; pos++) {
+                median_clear(&median);
+                median_add_rows(params, &median, rows, start[pos], start[pos + 1]);
+                if (missing_right)
+                    median_add_rows(params, &median, rows, start[num_buckets], n);
+                scores[2 * pos + missing_right] = median_abs_error(&median);
+                median_clear(&median);
+                for (other = 0; other < num_buckets; other++)
+                    if (other != pos)
+                        median_add_rows(params, &median, rows, start[other], start[other + 1]);
+                if (!missing_right)
+                    median_add_rows(params, &median, rows, start[num_buckets], n);
+                scores[2 * pos + missing_right] += median_abs_error(&median);
+            }
+        } else {
+            median_clear(&median);
+            if (!missing_right)
+                median_add_rows(params, &median, rows, start[num_buckets], n);
+            for (pos = 0; pos < num_buckets; pos++) {
+                median_add_rows(params, &median, rows, start[pos], start[pos + 1]);
+                scores[2 * pos + missing_right] = median_abs_error(&median);
+            }
+            median_clear(&median);
+            if (missing_right)
+                median_add_rows(params, &median, rows, start[num_buckets], n);
+            for (pos = num_buckets - 1; pos > 0; pos--) {
+                median_add_rows(params, &median, rows, start[pos], start[pos + 1]);
+                scores[2 * (pos - 1) + missing_right] += median_abs_error(&median);
+            }
+        }
+        for (pos = 0; pos < num_buckets; pos++)
+            scores[2 * pos + missing_right] /= node_stats[0];
+    }
+    median_destroy(&median);
+
+    free(node_rows);
+    free(row_pos);
+    free(pos_of);
+    free(start);
+    free(rows);
+}
+
+// Finds the attribute and base that minimize the weighted score of the two sides. Discrete
+// attributes are split on a value against the rest, continuous ones on a threshold. Categorical
+// attributes are split on a subset of their categories against the rest: the node's categories
+// are ordered by get_category_key and every prefix of that order is tried like a threshold,
+// which finds the best subset for regressors and for two classes in O(k log k) for k categories.
+// Rows missing the attribute are tried on the left and then on the right of each split. The
+// best split is put in best, whose attr_idx is -1 if no split has rows with a value on both
+// sides and whose categories are owned by the caller. Returns the score of the best split
+// With max_features set, attributes are visited in a random order and the search stops after
+// max_features of them, or later if none of those could be split
+static float find_best_split(DTTrainParams* params, double* node_stats, DTNode* best)
+{
+    DTTrainConfig*  config      = params->config;
+    DTData*         data        = params->data;
+    Bitset*         bitset      = params->bitset;
+    int             num_stats   = params->num_stats;
+
+    DTEntry* entries;
+    DTEntry* order;
+    float* bucket_values;
+    double* bucket_stats;
+    double* stats_left;
+    double* stats_right;
+    double* stats_below;
+    double* missing_stats;
+    double* abs_scores;
+    int* attr_order;
+    int attr_idx, num_buckets, discrete, categorical, missing_right;
+    int pos, best_pos, target, i, j, n, m;
+    DTEnum feature_type;
+    float best_score;
+    int sample_attr;
+
+    n = bitset_numset(bitset);
+    sample_attr = params->max_features > 0 && params->max_features < data->num_attr;
+    attr_order = malloc(data->num_attr * sizeof(int));
+    for (i = 0; i < data->num_attr; i++)
+        attr_order[i] = i;
+    m = (n > config->num_random_splits) ? n : config->num_random_splits;
+    entries = malloc(n * sizeof(DTEntry));
+    order = malloc((m + 1) * sizeof(DTEntry));
+    bucket_values = malloc((m + 1) * sizeof(float));
+    bucket_stats = malloc((m + 1) * num_stats * sizeof(double));
+    stats_left = malloc(num_stats * sizeof(double));
+    stats_right = malloc(num_stats * sizeof(double));
+    stats_below = malloc(num_stats * sizeof(double));
+    missing_stats = malloc(num_stats * sizeof(double));
+    abs_scores = NULL;
+    if (config->splitter == DT_SPLIT_ABS_ERROR)
+        abs_scores = malloc(2 * (m + 1) * sizeof(double));
+
+    target = 0;
+    for (i = 1; i < params->num_unique_labels; i++)
+        if (node_stats[1 + i] > node_stats[1 + target])
+            target = i;
+
+    best_score = 1e9;
+    best->attr_idx = -1;
+    best->base = -1;
+    best->discrete = -1;
+    best->missing_right = 0;
+    best->num_categories = 0;
+    best->categories = NULL;
+
+    for (i = 0; i < data->num_attr; i++) {
+        if (sample_attr) {
+            if (i >= params->max_features && best->attr_idx != -1)
+                break;
+            j = i + rng_next(&params->rng) % (data->num_attr - i);
+            attr_idx = attr_order[j];
+            attr_order[j] = attr_order[i];
+            attr_order[i] = attr_idx;
+        }
+        attr_idx = attr_order[i];
+        feature_type = get_feature_type(params, attr_idx);
+        categorical = feature_type == DT_FEATURE_CATEGORICAL;
+        if (config->num_random_splits > 0 && !categorical) {
+            num_buckets = get_buckets_random(params, attr_idx, node_stats, entries, bucket_values, bucket_stats, missing_stats);
+            discrete = 0;
+        } else {
+            num_buckets = get_buckets(params, attr_idx, node_stats, entries, bucket_values, bucket_stats, missing_stats);
+            discrete = feature_type == DT_FEATURE_AUTO && num_buckets <= config->min_samples_split;
+        }
+
+        // buckets are visited in order of value, or of key for categorical attributes
+        for (pos = 0; pos < num_buckets; pos++) {
+            order[pos].value = (categorical) ? get_category_key(params, bucket_stats + pos * num_stats, target) : 0;
+            order[pos].label_idx = pos;
+        }
+        if (categorical)
+            qsort(order, num_buckets, sizeof(DTEntry), compare_entries_rows);
+
+        if (config->splitter == DT_SPLIT_ABS_ERROR && num_buckets > 1)
+            get_abs_error_scores(params, attr_idx, node_stats, num_buckets, bucket_values, order, discrete, abs_scores);
+        best_pos = params->sweep_buckets(params, node_stats, bucket_stats, missing_stats, order, num_buckets, discrete, abs_scores, stats_left, stats_right, stats_below, &best_score, &missing_right);
+        if (best_pos != -1) {
+            best->attr_idx = attr_idx;
+            best->base = (categorical) ? 0 : bucket_values[order[best_pos].label_idx];
+            best->discrete = discrete;
+            best->missing_right = missing_right;
+            best->num_categories = 0;
+            free(best->categories);
+            best->categories = NULL;
+        }
+
+        // the categories of the best split are only gathered once the attribute is done
+        if (categorical && best_pos != -1)
+            set_categories(best, order, best_pos + 1, num_buckets, bucket_values);
+    }
+
+    free(attr_order);
+    free(entries);
+    free(order);
+    free(bucket_values);
+    free(bucket_stats);
+    free(stats_left);
+    free(stats_right);
+    free(stats_below);
+    free(missing_stats);
+    free(abs_scores);
+
+    return best_score;
+}
+
+// Gives node the split found by find_best_split, and with it the split's categories
+static void set_split(DTNode* node, DTNode* split)
+{
+    node->attr_idx = split->attr_idx;
+    node->discrete = split->discrete;
+    node->missing_right = split->missing_right;
+    node->base = split->base;
+    node->num_categories = split->num_categories;
+    node->categories = split->categories;
+}
+
+// Absolute error leaves predict the median of their rows, which minimizes it
+static void set_leaf(DTTrainParams* params, DTNode* node, double* node_stats)
+{
+    int uniq_idx, most_common_idx;
+    float abs_error;
+
+    if (params->config->type == DT_REGRESSOR && params->config->splitter == DT_SPLIT_ABS_ERROR) {
+        node->avg = get_node_median(params, &abs_error);
+        return;
+    }
+
+    if (params->config->type == DT_REGRESSOR) {
+        node->avg = (node_stats[0] == 0) ? 0 : node_stats[1] / node_stats[0];
+        return;
+    }
+
+    if (params->num_unique_labels == 0) {
+        node->label = -1;
+        return;
+    }
+
+    most_common_idx = 0;
+    for (uniq_idx = 1; uniq_idx < params->num_unique_labels; uniq_idx++)
+        if (node_stats[1 + uniq_idx] > node_stats[1 + most_common_idx])
+            most_common_idx = uniq_idx;
+    node->label = params->unique_labels[most_common_idx];
+}
+
+static int all_labels_equal(DTTrainParams* params, double* node_stats)
+{
+    int uniq_idx, num_present;
+
+    num_present = 0;
+    for (uniq_idx = 0; uniq_idx < params->num_unique_labels; uniq_idx++)
+        if (node_stats[1 + uniq_idx] > 0)
+            num_present++;
+
+    return num_present <= 1;
+}
+
+static void* decision_tree_train_helper(void* void_params)
+{
+    DTTrainParams       params              = *(DTTrainParams*)void_params;
+    DTTrainConfig*      config              = params.config;
+    DTData*             data                = params.data;
+    int                 depth               = params.depth;
+    int*                num_threads_ptr     = params.num_threads_ptr;
+    pthread_mutex_t*    num_threads_mutex   = params.num_threads_mutex;
+
+    if (params.thread_mutex != NULL)
+        pthread_mutex_unlock(params.thread_mutex);
+
+    DTNode* node;
+    DTTrainParams* new_params;
+    Bitset* bitset_left;
+    Bitset* bitset_right;
+    double* node_stats;
+    DTNode best;
+    int classifier_condition;
+    int num_threads;
+    pthread_t thid;
+    void* async_left;
+
+    node = malloc(sizeof(DTNode));
+    node->left = node->right = NULL;
+    node->base = 0;
+    node->attr_idx = -2;
+    node->discrete = -1;
+    node->missing_right = 0;
+    node->num_categories = 0;
+    node->categories = NULL;
+    node->label = -1;
+
+    node_stats = get_node_stats(&params);
+
+    classifier_condition = config->type == DT_CLASSIFIER && all_labels_equal(&params, node_stats);
+    if (depth >= config->max_depth || classifier_condition) {
+        set_leaf(&params, node, node_stats);
+        free(node_stats);
+        return node;
+    }
+
+    find_best_split(&params, node_stats, &best);
+
+    if (best.attr_idx == -1) {
+        set_leaf(&params, node, node_stats);
+        free(node_stats);
+        return node;
+    }
+
+    free(node_stats);
+
+    bitset_left = bitset_create(data->num_rows);
+    bitset_right = bitset_create(data->num_rows);
+    set_split(node, &best);
+    split(&params, node, bitset_left, bitset_right);
+
+    new_params = malloc(sizeof(DTTrainParams));
+    *new_params = params;
+    new_params->depth = depth + 1;
+    new_params->thread_mutex = NULL;
+
+    pthread_mutex_lock(num_threads_mutex);
+    num_threads = *num_threads_ptr;
+    if (num_threads < config->max_num_threads)
+        (*num_threads_ptr)++;
+    pthread_mutex_unlock(num_threads_mutex);
+
+    if (num_threads < config->max_num_threads) {
+        new_params->thread_mutex = malloc(sizeof(pthread_mutex_t));
+        pthread_mutex_init(new_params->thread_mutex, NULL);
+        pthread_mutex_lock(new_params->thread_mutex);
+        new_params->bitset = bitset_left;
+        new_params->rng = rng_next(&params.rng);
+        pthread_create(&thid, NULL, decision_tree_train_helper, new_params);
+        pthread_mutex_lock(new_params->thread_mutex);
+        pthread_mutex_destroy(new_params->thread_mutex);
+        free(new_params->thread_mutex);
+        new_params->thread_mutex = NULL;
+        new_params->bitset = bitset_right;
+        new_params->rng = rng_next(&params.rng);
+        node->right = decision_tree_train_helper(new_params);
+        pthread_join(thid, &async_left);
+        node->left = async_left;
+        pthread_mutex_lock(num_threads_mutex);
+        (*num_threads_ptr)--;
+        pthread_mutex_unlock(num_threads_mutex);
+    } else {
+        new_params->bitset = bitset_left;
+        new_params->rng = rng_next(&params.rng);
+        node->left = decision_tree_train_helper(new_params);
+        new_params->bitset = bitset_right;
+        new_params->rng = rng_next(&params.rng);
+        node->right = decision_tree_train_helper(new_params);
+    }
+
+    bitset_destroy(bitset_left);
+    bitset_destroy(bitset_right);
+    free(new_params);
+
+    return node;
+}
+
+// A leaf that best-first growth may split. gain is the decrease in weighted impurity its best
+// split gives, and order is the order leaves were made in, which breaks ties between gains
+typedef struct {
+    DTTrainParams   params;
+    DTNode*         node;
+    double*         stats;
+    float           gain;
+    int             order;
+    DTNode          split;
+} DTLeaf;
+
+static float get_impurity(DTTrainParams* params, double* node_stats)
+{
+    float abs_error;
+
+    if (params->config->type == DT_CLASSIFIER)
+        return calculate_split_classifier(params, node_stats);
+    if (params->config->splitter == DT_SPLIT_ABS_ERROR) {
+        get_node_median(params, &abs_error);
+        return abs_error;
+    }
+    return calculate_split_mse(node_stats);
+}
+
+static int leaf_better(DTLeaf* a, DTLeaf* b)
+{
+    return a->gain > b->gain || (a->gain == b->gain && a->order < b->order);
+}
+
+static void heap_push(DTLeaf* heap, int* heap_size, DTLeaf leaf)
+{
+    DTLeaf tmp;
+    int i = (*heap_size)++;
+    heap[i] = leaf;
+    while (i > 0 && leaf_better(&heap[i], &heap[(i-1)/2])) {
+        tmp = heap[i];
+        heap[i] = heap[(i-1)/2];
+        heap[(i-1)/2] = tmp;
+        i = (i-1)/2;
+    }
+}
+
+static DTLeaf heap_pop(DTLeaf* heap, int* heap_size)
+{
+    DTLeaf top, tmp;
+    int i, child;
+
+    top = heap[0];
+    heap[0] = heap[--(*heap_size)];
+    i = 0;
+    while (1) {
+        child = 2*i + 1;
+        if (child >= *heap_size)
+            break;
+        if (child + 1 < *heap_size && leaf_better(&heap[child+1], &heap[child]))
+            child++;
+        if (!leaf_better(&heap[child], &heap[i]))
+            break;
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+
+    return top;
+}
+
+// Makes a node for the rows in params->bitset. If it can be split, its best split is found and
+// it is pushed onto the heap, otherwise it becomes a leaf and its bitset is freed
+static DTNode* best_first_add(DTTrainParams* params, DTLeaf* heap, int* heap_size, int* order)
+{
+    DTTrainConfig* config = params->config;
+    DTLeaf leaf;
+    double* node_stats;
+    float score;
+
+    leaf.node = malloc(sizeof(DTNode));
+    leaf.node->left = leaf.node->right = NULL;
+    leaf.node->base = 0;
+    leaf.node->attr_idx = -2;
+    leaf.node->discrete = -1;
+    leaf.node->missing_right = 0;
+    leaf.node->num_categories = 0;
+    leaf.node->categories = NULL;
+    leaf.node->label = -1;
+
+    node_stats = get_node_stats(params);
+    leaf.split.attr_idx = -1;
+    score = 0;
+    if (!(params->depth >= config->max_depth || (config->type == DT_CLASSIFIER && all_labels_equal(params, node_stats))))
+        score = find_best_split(params, node_stats, &leaf.split);
+
+    if (leaf.split.attr_idx == -1) {
+        set_leaf(params, leaf.node, node_stats);
+        free(node_stats);
+        bitset_destroy(params->bitset);
+        return leaf.node;
+    }
+
+    leaf.params = *params;
+    leaf.stats = node_stats;
+    leaf.gain = node_stats[0] * (get_impurity(params, node_stats) - score);
+    leaf.order = (*order)++;
+    heap_push(heap, heap_size, leaf);
+
+    return leaf.node;
+}
+
+// Grows the tree by always splitting the leaf whose split decreases the weighted impurity the
+// most, until the tree has max_leaf_nodes leaves or no leaf can be split. The splits and
+// generators are those of depth-first growth, so without a limit the tree is the same
+static DTNode* train_best_first(DTTrainParams* params)
+{
+    DTTrainConfig*  config          = params->config;
+    DTData*         data            = params->data;
+    int             max_leaf_nodes  = config->max_leaf_nodes;
+
+    DTTrainParams child_params;
+    DTLeaf* heap;
+    DTLeaf leaf;
+    DTNode* root;
+    Bitset* bitset_left;
+    Bitset* bitset_right;
+    int heap_size, heap_capacity, num_leaves, order;
+
+    heap_capacity = 16;
+    heap = malloc(heap_capacity * sizeof(DTLeaf));
+    heap_size = 0;
+    order = 0;
+
+    child_params = *params;
+    child_params.bitset = bitset_create(data->num_rows);
+    for (int label_idx = 0; label_idx < data->num_rows; label_idx++)
+        if (bitset_isset(params->bitset, label_idx))
+            bitset_set(child_params.bitset, label_idx);
+    root = best_first_add(&child_params, heap, &heap_size, &order);
+    num_leaves = 1;
+
+    while (heap_size > 0 && (max_leaf_nodes == 0 || num_leaves < max_leaf_nodes)) {
+        leaf = heap_pop(heap, &heap_size);
+        if (heap_size + 2 > heap_capacity) {
+            heap_capacity *= 2;
+            heap = realloc(heap, heap_capacity * sizeof(DTLeaf));
+        }
+
+        bitset_left = bitset_create(data->num_rows);
+        bitset_right = bitset_create(data->num_rows);
+        set_split(leaf.node, &leaf.split);
+        split(&leaf.params, leaf.node, bitset_left, bitset_right);
+        bitset_destroy(leaf.params.bitset);
+        free(leaf.stats);
+
+        child_params = leaf.params;
+        child_params.depth++;
+        child_params.bitset = bitset_left;
+        child_params.rng = rng_next(&leaf.params.rng);
+        leaf.node->left = best_first_add(&child_params, heap, &heap_size, &order);
+        child_params.bitset = bitset_right;
+        child_params.rng = rng_next(&leaf.params.rng);
+        leaf.node->right = best_first_add(&child_params, heap, &heap_size, &order);
+        num_leaves++;
+    }
+
+    while (heap_size > 0) {
+        leaf = heap_pop(heap, &heap_size);
+        set_leaf(&leaf.params, leaf.node, leaf.stats);
+        free(leaf.stats);
+        free(leaf.split.categories);
+        bitset_destroy(leaf.params.bitset);
+    }
+    free(heap);
+
+    return root;
+}
+
+// Level-wise growth works on attributes quantized into at most DT_NUM_BINS bins. Bin b of an
+// attribute holds the values in (edges[b-1], edges[b]]. An attribute with at most DT_NUM_BINS
+// unique values gets a bin per value and is marked exact, so its splits are the same as
+// depth-first growth would find. uint8 attributes are their own bins and are not copied
+// Out of core, codes is NULL and each value is binned as it is read, with edges taken from a
+// sample of the rows
+#define DT_NUM_BINS         256
+
+// Upper bound on the doubles in one histogram buffer. Nodes are processed in groups that fit
+#define DT_HIST_SIZE        (1 << 20)
+
+// Upper bounds on the doubles in the histograms of one pass over the rows out of core, and on
+// the values sampled to place the bin edges
+#define DT_PASS_HIST_SIZE   (1 << 25)
+#define DT_SAMPLE_SIZE      (1 << 24)
+
+typedef struct DTBins {
+    int         num_rows;
+    int         num_attr;
+    DTData*     data;
+    uint8_t*    codes;
+    int         owns_codes;
+    int*        num_bins;
+    float*      edges;
+    uint8_t*    exact;
+} DTBins;
+
+// A split of level-wise growth. Bins up to bin go left, or every bin but bin if discrete, or
+// for a categorical split the bins set in right_bins go right
+typedef struct {
+    float       score;
+    int         pos;
+    int         attr_idx;
+    int         bin;
+    int         discrete;
+    int         categorical;
+    uint64_t    right_bins[DT_NUM_BINS / 64];
+} DTSplit;
+
+typedef struct {
+    DTNode*     node;
+    double*     stats;
+    uint64_t    rng;
+    int*        attr_order;
+    DTSplit     best;
+} DTLevelNode;
+
+// Data-parallel training. Each worker process holds a shard of the rows and the coordinator
+// holds none; they grow the tree level-wise in lockstep. After a worker connects it sends its
+// index, number of rows and number of attributes, and receives the config. Classifier workers
+// send their unique labels and receive the union, in shard order. Every worker sends the sorted
+// unique values of each attribute, or DT_NET_MAX_VALUES evenly spaced ones if it has more, and
+// receives the bin edges, which are the same as for all the rows in one process whenever no
+// worker had to leave values out. Workers then send the stats of the root and serve messages
+// until DT_MSG_DONE: DT_MSG_HIST lists (node, attribute) pairs whose histograms over the
+// worker's rows it sends back, and DT_MSG_ROUTE gives each node's split, or -1 for leaves, after
+// which it moves its rows down and sends back the stats of the next level. The coordinator sums
+// what the workers send in shard order and chooses the splits itself. Values are sent in the
+// processes' native representation, so they must all run on the same architecture
+#define DT_NET_MAX_VALUES   (1 << 16)
+#define DT_NET_TIMEOUT      60
+#define DT_NET_CHUNK        (1 << 16)
+
+#define DT_MSG_HIST         0
+#define DT_MSG_ROUTE        1
+#define DT_MSG_DONE         2
+
+// Ints per node in a DT_MSG_ROUTE message: the index of its left child or -1, the split's
+// attr_idx, bin, discrete and categorical, then its right_bins
+#define DT_ROUTE_SIZE       (5 + DT_NUM_BINS / 32)
+
+// The coordinator's connections, indexed by shard. Once a connection fails, failed is set and
+// the rest of the exchanges do nothing, so training runs to its end on empty histograms
+typedef struct {
+    int             num_workers;
+    NetSocket**     workers;
+    int             failed;
+} DTCluster;
+
+static void cluster_send(DTCluster* cluster, void* buf, size_t size)
+{
+    for (int i = 0; i < cluster->num_workers && !cluster->failed; i++)
+        if (!net_send(cluster->workers[i], buf, size))
+            cluster->failed = 1;
+}
+
+static void cluster_recv(DTCluster* cluster, int worker_idx, void* buf, size_t size)
+{
+    if (!cluster->failed && !net_recv(cluster->workers[worker_idx], buf, size))
+        cluster->failed = 1;
+    if (cluster->failed)
+        memset(buf, 0, size);
+}
+
+// Receives n doubles from every worker and stores their sum in sum, adding the workers in order
+static void cluster_sum(DTCluster* cluster, double* sum, size_t n)
+{
+    double* chunk;
+    size_t start, size, i;
+    int worker_idx;
+
+    memset(sum, 0, n * sizeof(double));
+    chunk = malloc(DT_NET_CHUNK * sizeof(double));
+    for (worker_idx = 0; worker_idx < cluster->num_workers; worker_idx++) {
+        for (start = 0; start < n; start += size) {
+            size = (n - start < DT_NET_CHUNK) ? n - start : DT_NET_CHUNK;
+            cluster_recv(cluster, worker_idx, chunk, size * sizeof(double));
+            for (i = 0; i < size; i++)
+                sum[start + i] += chunk[i];
+        }
+    }
+    free(chunk);
+}
+
+// One depth of the tree. node_of maps each row to its node in the level, or -1 once the row
+// has reached a leaf. Each round hands out attributes to workers, and attr_nodes lists the
+// nodes that consider an attribute together with its position in their attribute order, or is
+// NULL when every node in search_nodes considers every attribute. cluster is set on the
+// coordinator of data-parallel training, whose histograms come from its workers
+typedef struct {
+    DTTrainParams*      params;
+    DTBins*             bins;
+    DTCluster*          cluster;
+    int*                node_of;
+    int                 num_nodes;
+    DTLevelNode*        nodes;
+    int                 num_search_nodes;
+    int*                search_nodes;
+    int                 by_position;
+    int**               attr_nodes;
+    int**               attr_pos;
+    int*                attr_num_nodes;
+    int                 next_attr;
+    pthread_mutex_t     mutex;
+} DTLevel;
+
+static uint8_t get_bin(int num_bins, float* edges, float value)
+{
+    int lo = 0, hi = num_bins - 1, mid;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (edges[mid] < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+uint8_t decision_tree_get_bin(int num_bins, float* edges, float value)
+{
+    return get_bin(num_bins, edges, value);
+}
+
+static int compare_floats(const void* a, const void* b)
+{
+    float value_a = *(float*)a;
+    float value_b = *(float*)b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+// Places the edges of at most max_bins bins from num_values values, sorted in place, and
+// returns the number of bins. exact is set if every unique value got its own bin
+static int get_edges(int num_values, float* values, int max_bins, float* edges, int* exact)
+{
+    int num_unique, num_bins, i;
+    float edge;
+
+    // missing values have no place among the edges and fall into the first bin
+    num_unique = 0;
+    for (i = 0; i < num_values; i++)
+        if (!isnan(values[i]))
+            values[num_unique++] = values[i];
+    num_values = num_unique;
+
+    qsort(values, num_values, sizeof(float), compare_floats);
+
+    num_unique = 0;
+    for (i = 0; i < num_values; i++)
+        if (num_unique == 0 || values[i] != values[num_unique-1])
+            values[num_unique++] = values[i];
+
+    num_bins = 0;
+    if (num_unique <= max_bins) {
+        for (i = 0; i < num_unique; i++)
+            edges[num_bins++] = values[i];
+    } else {
+        for (i = 1; i <= max_bins; i++) {
+            edge = values[(size_t)i * num_unique / max_bins - 1];
+            if (num_bins == 0 || edge != edges[num_bins-1])
+                edges[num_bins++] = edge;
+        }
+    }
+    if (num_bins == 0)
+        edges[num_bins++] = 0;
+    *exact = num_unique <= max_bins;
+
+    return num_bins;
+}
+
+int decision_tree_bin_edges(int num_values, float* values, int max_bins, float* edges, int* exact)
+{
+    return get_edges(num_values, values, max_bins, edges, exact);
+}
+
+// Places the edges of an attribute from num_values of its values, sorted in place. exact is
+// only set if the values are all of the attribute's
+static void set_edges(DTBins* bins, int attr_idx, int num_values, float* values, int all_values)
+{
+    int exact;
+
+    bins->num_bins[attr_idx] = get_edges(num_values, values, DT_NUM_BINS, bins->edges + (size_t)attr_idx * DT_NUM_BINS, &exact);
+    bins->exact[attr_idx] = all_values && exact;
+}
+
+// Builds the bins of data. In memory the edges come from the rows in rows, or all rows if it is
+// NULL, and every row gets a code
+static void bins_init(DTBins* bins, DTData* data, Bitset* rows)
+{
+    int attr_idx, label_idx, num_sampled, num_values, i;
+    float* values;
+    float* edges;
+
+    bins->num_rows = data->num_rows;
+    bins->num_attr = data->num_attr;
+    bins->data = data;
+    bins->codes = NULL;
+    bins->owns_codes = 0;
+    bins->num_bins = malloc(data->num_attr * sizeof(int));
+    bins->edges = malloc((size_t)data->num_attr * DT_NUM_BINS * sizeof(float));
+    bins->exact = malloc(data->num_attr * sizeof(uint8_t));
+
+    if (data->type == DT_ATTR_UINT8) {
+        if (!data->row_major)
+            bins->codes = data->attr;
+        for (attr_idx = 0; attr_idx < data->num_attr; attr_idx++) {
+            bins->num_bins[attr_idx] = DT_NUM_BINS;
+            bins->exact[attr_idx] = 1;
+            for (i = 0; i < DT_NUM_BINS; i++)
+                bins->edges[attr_idx * DT_NUM_BINS + i] = i;
+        }
+        return;
+    }
+
+    // out of core the edges come from evenly spaced rows, read in order, as many as fit in
+    // DT_SAMPLE_SIZE values
+    if (data->row_major) {
+        num_sampled = DT_SAMPLE_SIZE / data->num_attr;
+        num_sampled = (num_sampled < data->num_rows) ? num_sampled : data->num_rows;
+        values = malloc((size_t)num_sampled * data->num_attr * sizeof(float));
+        for (i = 0; i < num_sampled; i++) {
+            label_idx = (size_t)i * data->num_rows / num_sampled;
+            for (attr_idx = 0; attr_idx < data->num_attr; attr_idx++)
+                values[(size_t)attr_idx * num_sampled + i] = get_value(data, attr_idx, label_idx);
+        }
+        for (attr_idx = 0; attr_idx < data->num_attr; attr_idx++)
+            set_edges(bins, attr_idx, num_sampled, values + (size_t)attr_idx * num_sampled, num_sampled == data->num_rows);
+        free(values);
+        return;
+    }
+
+    bins->codes = malloc((size_t)data->num_rows * data->num_attr * sizeof(uint8_t));
+    bins->owns_codes = 1;
+    values = malloc(data->num_rows * sizeof(float));
+
+    for (attr_idx = 0; attr_idx < data->num_attr; attr_idx++) {
+        num_values = 0;
+        for (label_idx = 0; label_idx < data->num_rows; label_idx++)
+            if (rows == NULL || bitset_isset(rows, label_idx))
+                values[num_values++] = get_value(data, attr_idx, label_idx);
+        set_edges(bins, attr_idx, num_values, values, 1);
+        edges = bins->edges + (size_t)attr_idx * DT_NUM_BINS;
+        for (label_idx = 0; label_idx < data->num_rows; label_idx++)
+            bins->codes[get_attr_idx(data->num_rows, attr_idx, label_idx)] = get_bin(bins->num_bins[attr_idx], edges, get_value(data, attr_idx, label_idx));
+    }
+
+    free(values);
+}
+
+static uint8_t get_code(DTBins* bins, int attr_idx, int label_idx)
+{
+    if (bins->codes != NULL)
+        return bins->codes[get_attr_idx(bins->num_rows, attr_idx, label_idx)];
+    if (bins->data->type == DT_ATTR_UINT8)
+        return ((uint8_t*)bins->data->attr)[(size_t)bins->num_attr * label_idx + attr_idx];
+    return get_bin(bins->num_bins[attr_idx], bins->edges + (size_t)attr_idx * DT_NUM_BINS, get_value(bins->data, attr_idx, label_idx));
+}
+
+static void bins_destroy(DTBins* bins)
+{
+    if (bins->owns_codes)
+        free(bins->codes);
+    free(bins->num_bins);
+    free(bins->edges);
+    free(bins->exact);
+}
+
+// Builds the bins of a dataset the first time a training needs them
+static DTBins* dataset_bins(DTDataset* ds)
+{
+    pthread_mutex_lock(&ds->mutex);
+    if (ds->bins == NULL) {
+        ds->bins = malloc(sizeof(DTBins));
+        bins_init(ds->bins, &ds->data, NULL);
+    }
+    pthread_mutex_unlock(&ds->mutex);
+    return ds->bins;
+}
+
+// Places the edges of every attribute from the values the workers send, and sends them back.
+// The coordinator has no codes
+static void cluster_bins(DTCluster* cluster, DTBins* bins, int num_attr)
+{
+    float* values;
+    size_t num_values, max_values;
+    int header[2];
+    int attr_idx, worker_idx, all_values;
+
+    bins->num_rows = 0;
+    bins->num_attr = num_attr;
+    bins->data = NULL;
+    bins->codes = NULL;
+    bins->owns_codes = 0;
+    bins->num_bins = malloc(num_attr * sizeof(int));
+    bins->edges = malloc((size_t)num_attr * DT_NUM_BINS * sizeof(float));
+    bins->exact = malloc(num_attr * sizeof(uint8_t));
+
+    max_values = (size_t)cluster->num_workers * DT_NET_MAX_VALUES;
+    values = malloc(max_values * sizeof(float));
+    for (attr_idx = 0; attr_idx < num_attr; attr_idx++) {
+        num_values = 0;
+        all_values = 1;
+        for (worker_idx = 0; worker_idx < cluster->num_workers; worker_idx++) {
+            cluster_recv(cluster, worker_idx, header, sizeof(header));
+            if (header[0] < 0 || header[0] > DT_NET_MAX_VALUES)
+                cluster->failed = 1;
+            if (cluster->failed)
+                break;
+            cluster_recv(cluster, worker_idx, values + num_values, header[0] * sizeof(float));
+            num_values += header[0];
+            all_values = all_values && header[1];
+        }
+        set_edges(bins, attr_idx, num_values, values, all_values);
+    }
+    free(values);
+
+    cluster_send(cluster, bins->num_bins, num_attr * sizeof(int));
+    cluster_send(cluster, bins->edges, (size_t)num_attr * DT_NUM_BINS * sizeof(float));
+    cluster_send(cluster, bins->exact, num_attr * sizeof(uint8_t));
+}
+
+// Returns whether a is a better split than b. Splits are compared by score and then by the
+// position of their attribute in the node's attribute order, the order depth-first growth
+// visits them in. Once a node has gone past max_features without a split only the first
+// attribute that splits counts, so the position is compared first
+static int split_better(DTSplit* a, DTSplit* b, int by_position)
+{
+    if (a->pos == -1)
+        return 0;
+    if (b->pos == -1)
+        return 1;
+    if (by_position && a->pos != b->pos)
+        return a->pos < b->pos;
+    return a->score < b->score || (a->score == b->score && a->pos < b->pos);
+}
+
+// Finds the best split of a categorical attribute on a subset of its bins against the rest. As
+// in find_best_split, the node's nonempty bins are ordered by get_category_key and swept like
+// buckets, and the bins after the best position go right
+static void find_best_subset(DTLevel* level, DTLevelNode* lnode, int attr_idx, int pos, double* hist, int num_nonempty, double* stats_left, double* stats_right, DTSplit* best)
+{
+    DTTrainParams*  params      = level->params;
+    int             num_stats   = params->num_stats;
+    int             num_bins    = level->bins->num_bins[attr_idx];
+    double*         node_stats  = lnode->stats;
+
+    DTEntry order[DT_NUM_BINS];
+    DTSplit split;
+    double* stats_below;
+    double* missing_stats;
+    float score;
+    int bin, best_pos, missing_right, target, i;
+
+    target = 0;
+    for (i = 1; i < params->num_unique_labels; i++)
+        if (node_stats[1 + i] > node_stats[1 + target])
+            target = i;
+
+    i = 0;
+    for (bin = 0; bin < num_bins; bin++) {
+        if (hist[bin * num_stats] == 0)
+            continue;
+        order[i].value = get_category_key(params, hist + bin * num_stats, target);
+        order[i].label_idx = bin;
+        i++;
+    }
+    qsort(order, num_nonempty, sizeof(DTEntry), compare_entries_rows);
+
+    // missing values are binned with the first bin, so there are none on their own
+    stats_below = malloc(num_stats * sizeof(double));
+    missing_stats = calloc(num_stats, sizeof(double));
+    score = best->score;
+    best_pos = params->sweep_buckets(params, node_stats, hist, missing_stats, order, num_nonempty, 0, NULL, stats_left, stats_right, stats_below, &score, &missing_right);
+    if (best_pos != -1) {
+        split = (DTSplit) { score, pos, attr_idx, -1, 0, 1, { 0 } };
+        for (i = best_pos + 1; i < num_nonempty; i++)
+            split.right_bins[order[i].label_idx / 64] |= (uint64_t)1 << (order[i].label_idx % 64);
+        *best = split;
+    }
+    free(stats_below);
+    free(missing_stats);
+}
+
+// Finds the best split of one node on one attribute from the node's histogram of that
+// attribute, with the same rules as find_best_split. best must start with a score of 1e9
+static void find_best_bin(DTLevel* level, DTLevelNode* lnode, int attr_idx, int pos, double* hist, double* stats_left, double* stats_right, DTSplit* best)
+{
+    DTTrainConfig*  config      = level->params->config;
+    DTBins*         bins        = level->bins;
+    int             num_stats   = level->params->num_stats;
+    int             num_bins    = bins->num_bins[attr_idx];
+    double*         node_stats  = lnode->stats;
+
+    int bin, first_bin, last_bin, num_nonempty, discrete, i, j;
+    DTEnum feature_type;
+    float score;
+    double* stats;
+    double* sides;
+    uint64_t rng;
+
+    num_nonempty = 0;
+    first_bin = last_bin = -1;
+    for (bin = 0; bin < num_bins; bin++) {
+        if (hist[bin * num_stats] == 0)
+            continue;
+        if (first_bin == -1)
+            first_bin = bin;
+        last_bin = bin;
+        num_nonempty++;
+    }
+    if (num_nonempty <= 1)
+        return;
+
+    feature_type = get_feature_type(level->params, attr_idx);
+    if (feature_type == DT_FEATURE_CATEGORICAL) {
+        find_best_subset(level, lnode, attr_idx, pos, hist, num_nonempty, stats_left, stats_right, best);
+        return;
+    }
+
+    // random thresholds are drawn as bins between the node's first and last nonempty bin,
+    // from a generator derived from the node's and the attribute's so workers agree. Each is
+    // scored by sweeping the two sides of its split as a histogram of two bins
+    if (config->num_random_splits > 0) {
+        rng = lnode->rng ^ (0x9E3779B97F4A7C15 * (uint64_t)(attr_idx + 1));
+        sides = calloc(2 * num_stats, sizeof(double));
+        for (i = 0; i < config->num_random_splits; i++) {
+            bin = first_bin + rng_next(&rng) % (last_bin - first_bin);
+            memset(sides, 0, num_stats * sizeof(double));
+            for (stats = hist + first_bin * num_stats; stats <= hist + bin * num_stats; stats += num_stats)
+                for (j = 0; j < num_stats; j++)
+                    sides[j] += stats[j];
+            for (j = 0; j < num_stats; j++)
+                sides[num_stats + j] = node_stats[j] - sides[j];
+            score = best->score;
+            if (level->params->sweep_bins(level->params, node_stats, sides, 0, 1, 0, stats_left, stats_right, &score) != -1)
+                *best = (DTSplit) { score, pos, attr_idx, bin, 0, 0, { 0 } };
+        }
+        free(sides);
+        return;
+    }
+
+    discrete = bins->exact[attr_idx] && feature_type == DT_FEATURE_AUTO && num_nonempty <= config->min_samples_split;
+    score = best->score;
+    bin = level->params->sweep_bins(level->params, node_stats, hist, first_bin, last_bin, discrete, stats_left, stats_right, &score);
+    if (bin != -1)
+        *best = (DTSplit) { score, pos, attr_idx, bin, discrete, 0, { 0 } };
+}
+
+// Takes attributes until there are none left. For each, the histograms of the nodes that
+// consider it are built in one sequential pass over the attribute's bins, as many nodes at a
+// time as fit in DT_HIST_SIZE. Returns the best split found for each node
+static void* level_worker(void* void_level)
+{
+    DTLevel*        level       = void_level;
+    DTTrainParams*  params      = level->params;
+    DTBins*         bins        = level->bins;
+    int             num_stats   = params->num_stats;
+    int             num_nodes   = level->num_nodes;
+    int*            node_of     = level->node_of;
+
+    DTSplit* best;
+    DTSplit split;
+    double* hist;
+    double* stats_left;
+    double* stats_right;
+    uint8_t* codes;
+    int* slot_of;
+    int attr_idx, node_idx, label_idx, slot, start, end, max_slots, num_attr_nodes, hist_size, i;
+
+    best = malloc(num_nodes * sizeof(DTSplit));
+    for (node_idx = 0; node_idx < num_nodes; node_idx++)
+        best[node_idx].pos = -1;
+    slot_of = malloc(num_nodes * sizeof(int));
+    for (node_idx = 0; node_idx < num_nodes; node_idx++)
+        slot_of[node_idx] = -1;
+    hist_size = (DT_HIST_SIZE > DT_NUM_BINS * num_stats) ? DT_HIST_SIZE : DT_NUM_BINS * num_stats;
+    hist = malloc(hist_size * sizeof(double));
+    stats_left = malloc(num_stats * sizeof(double));
+    stats_right = malloc(num_stats * sizeof(double));
+
+    while (1) {
+        pthread_mutex_lock(&level->mutex);
+        attr_idx = level->next_attr++;
+        pthread_mutex_unlock(&level->mutex);
+        if (attr_idx >= bins->num_attr)
+            break;
+
+        codes = bins->codes + get_attr_idx(bins->num_rows, attr_idx, 0);
+        num_attr_nodes = (level->attr_nodes == NULL) ? level->num_search_nodes : level->attr_num_nodes[attr_idx];
+        max_slots = hist_size / (bins->num_bins[attr_idx] * num_stats);
+
+        for (start = 0; start < num_attr_nodes; start = end) {
+            end = (start + max_slots < num_attr_nodes) ? start + max_slots : num_attr_nodes;
+            for (i = start; i < end; i++) {
+                node_idx = (level->attr_nodes == NULL) ? level->search_nodes[i] : level->attr_nodes[attr_idx][i];
+                slot_of[node_idx] = i - start;
+            }
+            memset(hist, 0, (size_t)(end - start) * bins->num_bins[attr_idx] * num_stats * sizeof(double));
+
+            for (label_idx = 0; label_idx < bins->num_rows; label_idx++) {
+                if (node_of[label_idx] < 0)
+                    continue;
+                slot = slot_of[node_of[label_idx]];
+                if (slot < 0)
+                    continue;
+                params->add_stats(params, hist + ((size_t)slot * bins->num_bins[attr_idx] + codes[label_idx]) * num_stats, label_idx);
+            }
+
+            for (i = start; i < end; i++) {
+                node_idx = (level->attr_nodes == NULL) ? level->search_nodes[i] : level->attr_nodes[attr_idx][i];
+                slot_of[node_idx] = -1;
+                split.score = 1e9;
+                split.pos = -1;
+                find_best_bin(level, &level->nodes[node_idx],
+                              attr_idx, (level->attr_nodes == NULL) ? attr_idx : level->attr_pos[attr_idx][i],
+                              hist + (size_t)(i - start) * bins->num_bins[attr_idx] * num_stats,
+                              stats_left, stats_right, &split);
+                if (split_better(&split, &best[node_idx], level->by_position))
+                    best[node_idx] = split;
+            }
+        }
+    }
+
+    free(slot_of);
+    free(hist);
+    free(stats_left);
+    free(stats_right);
+
+    return best;
+}
+
+// Out of core the histograms are built for (node, attribute) pairs. A pair's histogram starts
+// offset doubles into the buffer of the pass that builds it
+typedef struct {
+    int         node_idx;
+    int         attr_idx;
+    int         pos;
+    size_t      offset;
+} DTPair;
+
+// One worker of a pass over the rows. It builds and searches the histograms of the pairs from
+// start to end, or only builds them if best is NULL. Pairs are sorted by node and node_pairs
+// holds the first pair of each node
+typedef struct {
+    DTLevel*    level;
+    DTPair*     pairs;
+    int*        node_pairs;
+    int         start;
+    int         end;
+    double*     hist;
+    DTSplit*    best;
+} DTPassParams;
+
+// Searches the histograms of the pairs from start to end, keeping the best split of each node
+static void level_eval_pairs(DTLevel* level, DTPair* pairs, int start, int end, double* hist, DTSplit* best)
+{
+    int             num_stats   = level->params->num_stats;
+
+    DTPair* pair;
+    DTSplit split;
+    double* stats_left;
+    double* stats_right;
+    int i;
+
+    stats_left = malloc(num_stats * sizeof(double));
+    stats_right = malloc(num_stats * sizeof(double));
+    for (i = start; i < end; i++) {
+        pair = &pairs[i];
+        split.score = 1e9;
+        split.pos = -1;
+        find_best_bin(level, &level->nodes[pair->node_idx], pair->attr_idx, pair->pos, hist + pair->offset, stats_left, stats_right, &split);
+        if (split_better(&split, &best[pair->node_idx], level->by_position))
+            best[pair->node_idx] = split;
+    }
+    free(stats_left);
+    free(stats_right);
+}
+
+static void* level_pass_worker(void* void_params)
+{
+    DTPassParams*   pass        = void_params;
+    DTLevel*        level       = pass->level;
+    DTTrainParams*  params      = level->params;
+    DTBins*         bins        = level->bins;
+    DTPair*         pairs       = pass->pairs;
+    int             num_stats   = params->num_stats;
+
+    int label_idx, node_idx, start, end, i;
+
+    for (label_idx = 0; label_idx < bins->num_rows; label_idx++) {
+        node_idx = level->node_of[label_idx];
+        if (node_idx < 0)
+            continue;
+        start = (pass->node_pairs[node_idx] > pass->start) ? pass->node_pairs[node_idx] : pass->start;
+        end = (pass->node_pairs[node_idx+1] < pass->end) ? pass->node_pairs[node_idx+1] : pass->end;
+        for (i = start; i < end; i++)
+            params->add_stats(params, pass->hist + pairs[i].offset + get_code(bins, pairs[i].attr_idx, label_idx) * num_stats, label_idx);
+    }
+
+    if (pass->best != NULL)
+        level_eval_pairs(level, pairs, pass->start, pass->end, pass->hist, pass->best);
+
+    return NULL;
+}
+
+// Has every worker build the histograms of num_pairs pairs over its rows, size doubles in all,
+// and adds them up
+static void cluster_hist(DTCluster* cluster, DTPair* pairs, int num_pairs, double* hist, size_t size)
+{
+    int header[2] = { DT_MSG_HIST, num_pairs };
+    int* msg;
+    int i;
+
+    msg = malloc(2 * (size_t)num_pairs * sizeof(int));
+    for (i = 0; i < num_pairs; i++) {
+        msg[2*i] = pairs[i].node_idx;
+        msg[2*i+1] = pairs[i].attr_idx;
+    }
+    cluster_send(cluster, header, sizeof(header));
+    cluster_send(cluster, msg, 2 * (size_t)num_pairs * sizeof(int));
+    free(msg);
+
+    cluster_sum(cluster, hist, size);
+}
+
+// Searches the splits of the level with row-major attributes, or across the workers of a
+// cluster. The pairs of the searching nodes and the attributes they consider are split into
+// passes whose histograms fit in DT_PASS_HIST_SIZE, and each pass reads the rows once in order,
+// its pairs spread over the workers
+static void level_find_splits_rows(DTLevel* level)
+{
+    DTTrainConfig*  config      = level->params->config;
+    DTBins*         bins        = level->bins;
+    int             num_stats   = level->params->num_stats;
+    int             num_nodes   = level->num_nodes;
+
+    DTPassParams* passes;
+    pthread_t* threads;
+    DTPair* pairs;
+    double* hist;
+    int* node_pairs;
+    int* next;
+    int num_pairs, num_threads, node_idx, attr_idx, start, end, i, j;
+    size_t size, hist_size, pair_size;
+
+    node_pairs = calloc(num_nodes + 1, sizeof(int));
+    if (level->attr_nodes == NULL) {
+        for (i = 0; i < level->num_search_nodes; i++)
+            node_pairs[level->search_nodes[i] + 1] = bins->num_attr;
+    } else {
+        for (attr_idx = 0; attr_idx < bins->num_attr; attr_idx++)
+            for (j = 0; j < level->attr_num_nodes[attr_idx]; j++)
+                node_pairs[level->attr_nodes[attr_idx][j] + 1]++;
+    }
+    for (node_idx = 0; node_idx < num_nodes; node_idx++)
+        node_pairs[node_idx+1] += node_pairs[node_idx];
+    num_pairs = node_pairs[num_nodes];
+
+    pairs = malloc(num_pairs * sizeof(DTPair));
+    next = malloc(num_nodes * sizeof(int));
+    memcpy(next, node_pairs, num_nodes * sizeof(int));
+    if (level->attr_nodes == NULL) {
+        for (i = 0; i < level->num_search_nodes; i++) {
+            node_idx = level->search_nodes[i];
+            for (attr_idx = 0; attr_idx < bins->num_attr; attr_idx++)
+                pairs[next[node_idx]++] = (DTPair) { node_idx, attr_idx, attr_idx, 0 };
+        }
+    } else {
+        for (attr_idx = 0; attr_idx < bins->num_attr; attr_idx++) {
+            for (j = 0; j < level->attr_num_nodes[attr_idx]; j++) {
+                node_idx = level->attr_nodes[attr_idx][j];
+                pairs[next[node_idx]++] = (DTPair) { node_idx, attr_idx, level->attr_pos[attr_idx][j], 0 };
+            }
+        }
+    }
+    free(next);
+
+    hist_size = 0;
+    for (i = 0; i < num_pairs; i++)
+        hist_size += (size_t)bins->num_bins[pairs[i].attr_idx] * num_stats;
+    if (hist_size > DT_PASS_HIST_SIZE)
+        hist_size = (DT_PASS_HIST_SIZE > DT_NUM_BINS * num_stats) ? DT_PASS_HIST_SIZE : DT_NUM_BINS * num_stats;
+    hist = malloc(hist_size * sizeof(double));
+
+    num_threads = (config->max_num_threads > 1) ? config->max_num_threads : 1;
+    threads = malloc(num_threads * sizeof(pthread_t));
+    passes = malloc(num_threads * sizeof(DTPassParams));
+    for (i = 0; i < num_threads; i++) {
+        passes[i].level = level;
+        passes[i].pairs = pairs;
+        passes[i].node_pairs = node_pairs;
+        passes[i].hist = hist;
+        passes[i].best = malloc(num_nodes * sizeof(DTSplit));
+        for (node_idx = 0; node_idx < num_nodes; node_idx++)
+            passes[i].best[node_idx].pos = -1;
+    }
+
+    for (start = 0; start < num_pairs; start = end) {
+        size = 0;
+        for (end = start; end < num_pairs; end++) {
+            pair_size = (size_t)bins->num_bins[pairs[end].attr_idx] * num_stats;
+            if (end > start && size + pair_size > hist_size)
+                break;
+            pairs[end].offset = size;
+            size += pair_size;
+        }
+        if (level->cluster != NULL) {
+            cluster_hist(level->cluster, pairs + start, end - start, hist, size);
+            level_eval_pairs(level, pairs, start, end, hist, passes[0].best);
+            continue;
+        }
+        memset(hist, 0, size * sizeof(double));
+
+        for (i = 0; i < num_threads; i++) {
+            passes[i].start = start + (size_t)(end - start) * i / num_threads;
+            passes[i].end = start + (size_t)(end - start) * (i + 1) / num_threads;
+        }
+        for (i = 1; i < num_threads; i++)
+            pthread_create(&threads[i], NULL, level_pass_worker, &passes[i]);
+        level_pass_worker(&passes[0]);
+        for (i = 1; i < num_threads; i++)
+            pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < num_threads; i++) {
+        for (node_idx = 0; node_idx < num_nodes; node_idx++)
+            if (split_better(&passes[i].best[node_idx], &level->nodes[node_idx].best, level->by_position))
+                level->nodes[node_idx].best = passes[i].best[node_idx];
+        free(passes[i].best);
+    }
+
+    free(passes);
+    free(threads);
+    free(hist);
+    free(pairs);
+    free(node_pairs);
+}
+
+// Runs the workers over the attributes and keeps the best split of each node
+static void level_find_splits(DTLevel* level)
+{
+    DTTrainConfig* config = level->params->config;
+    pthread_t* threads;
+    DTSplit* best;
+    int num_threads, i, node_idx;
+
+    if (level->bins->codes == NULL || level->cluster != NULL) {
+        level_find_splits_rows(level);
+        return;
+    }
+
+    num_threads = (config->max_num_threads < level->bins->num_attr) ? config->max_num_threads : level->bins->num_attr;
+    num_threads = (num_threads < 1) ? 1 : num_threads;
+    threads = malloc(num_threads * sizeof(pthread_t));
+    level->next_attr = 0;
+
+    for (i = 1; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, level_worker, level);
+    for (i = 0; i < num_threads; i++) {
+        if (i == 0)
+            best = level_worker(level);
+        else
+            pthread_join(threads[i], (void**)&best);
+        for (node_idx = 0; node_idx < level->num_nodes; node_idx++)
+            if (split_better(&best[node_idx], &level->nodes[node_idx].best, level->by_position))
+                level->nodes[node_idx].best = best[node_idx];
+        free(best);
+    }
+
+    free(threads);
+}
+
+// Lists, for each attribute, the nodes whose attribute order has it between positions start
+// and end, for the nodes that are still searching
+static void level_assign_attr(DTLevel* level, int* searching, int start_pos, int* end_pos)
+{
+    DTLevelNode* lnode;
+    int node_idx, pos, attr_idx, n;
+
+    level->attr_num_nodes = calloc(level->bins->num_attr, sizeof(int));
+    for (node_idx = 0; node_idx < level->num_nodes; node_idx++) {
+        if (!searching[node_idx])
+            continue;
+        lnode = &level->nodes[node_idx];
+        for (pos = start_pos; pos < end_pos[node_idx]; pos++)
+            level->attr_num_nodes[lnode->attr_order[pos]]++;
+    }
+
+    level->attr_nodes = malloc(level->bins->num_attr * sizeof(int*));
+    level->attr_pos = malloc(level->bins->num_attr * sizeof(int*));
+    for (attr_idx = 0; attr_idx < level->bins->num_attr; attr_idx++) {
+        level->attr_nodes[attr_idx] = malloc(level->attr_num_nodes[attr_idx] * sizeof(int));
+        level->attr_pos[attr_idx] = malloc(level->attr_num_nodes[attr_idx] * sizeof(int));
+        level->attr_num_nodes[attr_idx] = 0;
+    }
+
+    for (node_idx = 0; node_idx < level->num_nodes; node_idx++) {
+        if (!searching[node_idx])
+            continue;
+        lnode = &level->nodes[node_idx];
+        for (pos = start_pos; pos < end_pos[node_idx]; pos++) {
+            attr_idx = lnode->attr_order[pos];
+            n = level->attr_num_nodes[attr_idx]++;
+            level->attr_nodes[attr_idx][n] = node_idx;
+            level->attr_pos[attr_idx][n] = pos;
+        }
+    }
+}
+
+static void level_free_attr(DTLevel* level)
+{
+    if (level->attr_nodes == NULL)
+        return;
+    for (int attr_idx = 0; attr_idx < level->bins->num_attr; attr_idx++) {
+        free(level->attr_nodes[attr_idx]);
+        free(level->attr_pos[attr_idx]);
+    }
+    free(level->attr_nodes);
+    free(level->attr_pos);
+    free(level->attr_num_nodes);
+    level->attr_nodes = NULL;
+    level->attr_pos = NULL;
+    level->attr_num_nodes = NULL;
+}
+
+// Searches the splits of every node in the level. With max_features, each node first considers
+// the first max_features attributes of its random order like depth-first growth does, and the
+// nodes left without a split then consider the rest, keeping the first attribute that splits.
+// The nodes' generators end in the same state as after find_best_split
+static void level_search(DTLevel* level, int* searching)
+{
+    DTTrainParams*  params          = level->params;
+    int             num_attr        = level->bins->num_attr;
+    int             max_features    = params->max_features;
+
+    DTLevelNode* lnode;
+    int* end_pos;
+    int node_idx, pos, j, attr_idx, stop;
+    uint64_t rng;
+
+    level->by_position = 0;
+    level->attr_nodes = NULL;
+    if (!(max_features > 0 && max_features < num_attr)) {
+        level->search_nodes = malloc(level->num_nodes * sizeof(int));
+        level->num_search_nodes = 0;
+        for (node_idx = 0; node_idx < level->num_nodes; node_idx++)
+            if (searching[node_idx])
+                level->search_nodes[level->num_search_nodes++] = node_idx;
+        level_find_splits(level);
+        free(level->search_nodes);
+        return;
+    }
+
+    end_pos = malloc(level->num_nodes * sizeof(int));
+    for (node_idx = 0; node_idx < level->num_nodes; node_idx++) {
+        lnode = &level->nodes[node_idx];
+        end_pos[node_idx] = max_features;
+        lnode->attr_order = malloc(num_attr * sizeof(int));
+        for (pos = 0; pos < num_attr; pos++)
+            lnode->attr_order[pos] = pos;
+        if (!searching[node_idx])
+            continue;
+        for (pos = 0; pos < max_features; pos++) {
+            j = pos + rng_next(&lnode->rng) % (num_attr - pos);
+            attr_idx = lnode->attr_order[j];
+            lnode->attr_order[j] = lnode->attr_order[pos];
+            lnode->attr_order[pos] = attr_idx;
+        }
+    }
+    level_assign_attr(level, searching, 0, end_pos);
+    level_find_splits(level);
+    level_free_attr(level);
+
+    for (node_idx = 0; node_idx < level->num_nodes; node_idx++) {
+        lnode = &level->nodes[node_idx];
+        searching[node_idx] = searching[node_idx] && lnode->best.pos == -1;
+        if (!searching[node_idx])
+            continue;
+        end_pos[node_idx] = num_attr;
+        rng = lnode->rng;
+        for (pos = max_features; pos < num_attr; pos++) {
+            j = pos + rng_next(&rng) % (num_attr - pos);
+            attr_idx = lnode->attr_order[j];
+            lnode->attr_order[j] = lnode->attr_order[pos];
+            lnode->attr_order[pos] = attr_idx;
+        }
+    }
+    level->by_position = 1;
+    level_assign_attr(level, searching, max_features, end_pos);
+    level_find_splits(level);
+    level_free_attr(level);
+
+    // draw as many numbers as depth-first growth would have before it stopped
+    for (node_idx = 0; node_idx < level->num_nodes; node_idx++) {
+        if (!searching[node_idx])
+            continue;
+        lnode = &level->nodes[node_idx];
+        stop = (lnode->best.pos == -1) ? num_attr : lnode->best.pos + 1;
+        for (pos = max_features; pos < stop; pos++)
+            rng_next(&lnode->rng);
+    }
+
+    for (node_idx = 0; node_idx < level->num_nodes; node_idx++)
+        free(level->nodes[node_idx].attr_order);
+    free(end_pos);
+}
+
+// Moves each row of the level to its child, or out of the tree if its node became a leaf, and
+// adds it to the child's stats. child_of holds the index of each node's left child or -1, and
+// next_stats the stats of each node of the next level
+static void level_route(DTLevel* level, int* child_of, double* next_stats)
+{
+    DTTrainParams*  params      = level->params;
+    DTBins*         bins        = level->bins;
+    int             num_stats   = params->num_stats;
+
+    DTSplit* best;
+    int label_idx, node_idx, right;
+    uint8_t code;
+
+    for (label_idx = 0; label_idx < bins->num_rows; label_idx++) {
+        node_idx = level->node_of[label_idx];
+        if (node_idx < 0)
+            continue;
+        if (child_of[node_idx] < 0) {
+            level->node_of[label_idx] = -1;
+            continue;
+        }
+        best = &level->nodes[node_idx].best;
+        code = get_code(bins, best->attr_idx, label_idx);
+        if (best->categorical)
+            right = (best->right_bins[code / 64] >> (code % 64)) & 1;
+        else
+            right = (best->discrete) ? code == best->bin : code > best->bin;
+        level->node_of[label_idx] = child_of[node_idx] + right;
+        params->add_stats(params, next_stats + (size_t)(child_of[node_idx] + right) * num_stats, label_idx);
+    }
+}
+
+// Sends the level's splits to the workers and sums the stats of the next level they send back
+static void cluster_route(DTLevel* level, int* child_of, int num_next, double* next_stats)
+{
+    int header[2] = { DT_MSG_ROUTE, num_next };
+    DTSplit* best;
+    int* msg;
+    int node_idx;
+
+    msg = malloc(DT_ROUTE_SIZE * (size_t)level->num_nodes * sizeof(int));
+    for (node_idx = 0; node_idx < level->num_nodes; node_idx++) {
+        best = &level->nodes[node_idx].best;
+        msg[DT_ROUTE_SIZE*node_idx] = child_of[node_idx];
+        msg[DT_ROUTE_SIZE*node_idx+1] = best->attr_idx;
+        msg[DT_ROUTE_SIZE*node_idx+2] = best->bin;
+        msg[DT_ROUTE_SIZE*node_idx+3] = best->discrete;
+        msg[DT_ROUTE_SIZE*node_idx+4] = best->categorical;
+        memcpy(msg + DT_ROUTE_SIZE*node_idx + 5, best->right_bins, sizeof(best->right_bins));
+    }
+    cluster_send(level->cluster, header, sizeof(header));
+    cluster_send(level->cluster, msg, DT_ROUTE_SIZE * (size_t)level->num_nodes * sizeof(int));
+    free(msg);
+
+    cluster_sum(level->cluster, next_stats, (size_t)num_next * level->params->num_stats);
+}
+
+// Gives node the categories of a categorical split on bins. Bin b holds the categories in
+// (edges[b-1], edges[b]], so a bin that goes right sends all of them right. Missing values are
+// binned with the first bin and go its way
+static void set_bin_categories(DTNode* node, DTBins* bins, DTSplit* split)
+{
+    float* edges = bins->edges + (size_t)split->attr_idx * DT_NUM_BINS;
+    int bin, category, first, last;
+
+    node->discrete = 0;
+    node->base = 0;
+    node->missing_right = split->right_bins[0] & 1;
+    node->num_categories = 1;
+    for (bin = 0; bin < bins->num_bins[split->attr_idx]; bin++)
+        if (((split->right_bins[bin / 64] >> (bin % 64)) & 1) && edges[bin] >= node->num_categories)
+            node->num_categories = (edges[bin] < DT_MAX_LEVELS) ? (int)edges[bin] + 1 : DT_MAX_LEVELS;
+    node->categories = calloc((node->num_categories + 63) / 64, sizeof(uint64_t));
+    for (bin = 0; bin < bins->num_bins[split->attr_idx]; bin++) {
+        if (!((split->right_bins[bin / 64] >> (bin % 64)) & 1) || !(edges[bin] >= 0))
+            continue;
+        first = (bin == 0 || edges[bin-1] < 0) ? 0 : (edges[bin-1] < node->num_categories) ? (int)edges[bin-1] + 1 : node->num_categories;
+        last = (edges[bin] < node->num_categories) ? (int)edges[bin] : node->num_categories - 1;
+        for (category = first; category <= last; category++)
+            node->categories[category / 64] |= (uint64_t)1 << (category % 64);
+    }
+}
+
+// Grows the tree one depth at a time. Each level searches the splits of all of its nodes with
+// one pass over each attribute, then routes every row to its child in one more pass. With a
+// cluster the rows are the workers' and the passes happen there
+static DTNode* train_level_wise(DTTrainParams* params, DTCluster* cluster)
+{
+    DTTrainConfig*  config      = params->config;
+    DTData*         data        = params->data;
+    int             num_stats   = params->num_stats;
+
+    DTBins bins;
+    DTLevel level;
+    DTLevelNode* lnode;
+    DTLevelNode* next_nodes;
+    DTNode* node;
+    DTNode* root;
+    DTSplit* best;
+    double* stats;
+    double* next_stats;
+    int* searching;
+    int* child_of;
+    int num_next, node_idx, label_idx, depth, owns_bins, i;
+
+    // a weighted training on a dataset is a cross-validation fold, whose bins must not see the
+    // rows it holds out, so it bins its own rows rather than sharing the dataset's bins
+    owns_bins = params->dataset == NULL || params->weights != NULL;
+    if (cluster != NULL)
+        cluster_bins(cluster, &bins, data->num_attr);
+    else if (!owns_bins)
+        bins = *dataset_bins(params->dataset);
+    else
+        bins_init(&bins, data, (params->dataset != NULL) ? params->bitset : NULL);
+
+    level.params = params;
+    level.bins = &bins;
+    level.cluster = cluster;
+    level.node_of = malloc(data->num_rows * sizeof(int));
+    level.attr_nodes = NULL;
+    pthread_mutex_init(&level.mutex, NULL);
+
+    if (cluster != NULL) {
+        stats = malloc(num_stats * sizeof(double));
+        cluster_sum(cluster, stats, num_stats);
+    } else {
+        stats = get_node_stats(params);
+    }
+
+    root = malloc(sizeof(DTNode));
+    level.num_nodes = 1;
+    level.nodes = malloc(sizeof(DTLevelNode));
+    level.nodes[0].node = root;
+    level.nodes[0].stats = stats;
+    level.nodes[0].rng = params->rng;
+    for (label_idx = 0; label_idx < data->num_rows; label_idx++)
+        level.node_of[label_idx] = bitset_isset(params->bitset, label_idx) ? 0 : -1;
+
+    for (depth = 0; level.num_nodes > 0; depth++) {
+        searching = malloc(level.num_nodes * sizeof(int));
+        for (node_idx = 0; node_idx < level.num_nodes; node_idx++) {
+            lnode = &level.nodes[node_idx];
+            node = lnode->node;
+            node->left = node->right = NULL;
+            node->base = 0;
+            node->attr_idx = -2;
+            node->discrete = -1;
+            node->missing_right = 0;
+            node->num_categories = 0;
+            node->categories = NULL;
+            node->label = -1;
+            lnode->best.pos = -1;
+            searching[node_idx] = !(depth >= config->max_depth || (config->type == DT_CLASSIFIER && all_labels_equal(params, lnode->stats)));
+        }
+
+        level_search(&level, searching);
+
+        num_next = 0;
+        for (node_idx = 0; node_idx < level.num_nodes; node_idx++)
+            if (level.nodes[node_idx].best.pos != -1)
+                num_next += 2;
+        next_nodes = malloc(num_next * sizeof(DTLevelNode));
+        next_stats = calloc((size_t)num_next * num_stats, sizeof(double));
+        child_of = malloc(level.num_nodes * sizeof(int));
+
+        // the children of a split node are next to each other in the next level, and child_of
+        // holds the index of the left one
+        num_next = 0;
+        for (node_idx = 0; node_idx < level.num_nodes; node_idx++) {
+            lnode = &level.nodes[node_idx];
+            node = lnode->node;
+            best = &lnode->best;
+            child_of[node_idx] = -1;
+            if (best->pos == -1) {
+                set_leaf(params, node, lnode->stats);
+                continue;
+            }
+            node->attr_idx = best->attr_idx;
+            if (best->categorical) {
+                set_bin_categories(node, &bins, best);
+            } else {
+                node->discrete = best->discrete;
+                node->missing_right = best->discrete && best->bin == 0;
+                node->base = bins.edges[(size_t)best->attr_idx * DT_NUM_BINS + best->bin];
+            }
+            node->left = malloc(sizeof(DTNode));
+            node->right = malloc(sizeof(DTNode));
+            for (i = 0; i < 2; i++) {
+                next_nodes[num_next + i].node = (i == 0) ? node->left : node->right;
+                next_nodes[num_next + i].stats = next_stats + (size_t)(num_next + i) * num_stats;
+                next_nodes[num_next + i].rng = rng_next(&lnode->rng);
+            }
+            child_of[node_idx] = num_next;
+            num_next += 2;
+        }
+
+        if (cluster != NULL)
+            cluster_route(&level, child_of, num_next, next_stats);
+        else
+            level_route(&level, child_of, next_stats);
+
+        free(stats);
+        free(level.nodes);
+        free(searching);
+        free(child_of);
+        stats = next_stats;
+        level.nodes = next_nodes;
+        level.num_nodes = num_next;
+    }
+
+    free(stats);
+    free(level.nodes);
+    free(level.node_of);
+    pthread_mutex_destroy(&level.mutex);
+    if (owns_bins)
+        bins_destroy(&bins);
+
+    return root;
+}
+
+static int validate_config(DTTrainConfig* config)
+{
+    int type_valid = (
+            config->type == DT_CLASSIFIER
+        ||  config->type == DT_REGRESSOR
+    );
+    if (!type_valid) {
+        puts("Config type must be DT_CLASSIFIER or DT_REGRESSOR");
+        return 0;
+    }
+
+    int classifier_condition_valid = (
+            config->splitter == DT_SPLIT_ENTROPY
+        ||  config->splitter == DT_SPLIT_GINI
+        ||  config->splitter == DT_SPLIT_ERROR
+    );
+    if (config->type == DT_CLASSIFIER && !classifier_condition_valid) {
+        puts("Config condition for classifier must be DT_SPLIT_ENTROPY, DT_SPLIT_GINI, or DT_SPLIT_ERROR");
+        return 0;
+    }
+
+    int regressor_condition_valid = (
+            config->splitter == DT_SPLIT_MSE
+        ||  config->splitter == DT_SPLIT_ABS_ERROR
+    );
+
+    if (config->type == DT_REGRESSOR && !regressor_condition_valid) {
+        puts("Config condition for regressor must be DT_SPLIT_RMSE or DT_SPLIT_ABS_ERROR");
+        return 0;
+    }
+
+    if (config->min_samples_split < 2) {
+        puts("Config minimum samples split must be at least 2");
+        return 0;
+    }
+
+    if (config->max_depth <= 0) {
+        puts("Config max depth must be greater than 0");
+        return 0;
+    }
+
+    if (config->max_num_threads <= 0) {
+        puts("Config max num threads must be greater than 0");
+        return 0;
+    }
+
+    if (config->num_random_splits < 0) {
+        puts("Config num random splits must be at least 0");
+        return 0;
+    }
+
+    int feature_sampling_valid = (
+            config->feature_sampling == DT_FEATURES_ALL
+        ||  config->feature_sampling == DT_FEATURES_COUNT
+        ||  config->feature_sampling == DT_FEATURES_FRACTION
+        ||  config->feature_sampling == DT_FEATURES_SQRT
+    );
+    if (!feature_sampling_valid) {
+        puts("Config feature sampling must be DT_FEATURES_ALL, DT_FEATURES_COUNT, DT_FEATURES_FRACTION, or DT_FEATURES_SQRT");
+        return 0;
+    }
+
+    if (config->feature_sampling == DT_FEATURES_COUNT && config->max_features < 1) {
+        puts("Config max features must be at least 1 for DT_FEATURES_COUNT");
+        return 0;
+    }
+
+    if (config->feature_sampling == DT_FEATURES_FRACTION && !(config->max_features > 0 && config->max_features <= 1)) {
+        puts("Config max features must be greater than 0 and at most 1 for DT_FEATURES_FRACTION");
+        return 0;
+    }
+
+    int growth_valid = (
+            config->growth == DT_GROWTH_DEPTH
+        ||  config->growth == DT_GROWTH_LEVEL
+        ||  config->growth == DT_GROWTH_BEST
+    );
+    if (!growth_valid) {
+        puts("Config growth must be DT_GROWTH_DEPTH, DT_GROWTH_LEVEL, or DT_GROWTH_BEST");
+        return 0;
+    }
+
+    if (config->max_leaf_nodes < 0) {
+        puts("Config max leaf nodes must be at least 0");
+        return 0;
+    }
+
+    if (config->growth == DT_GROWTH_LEVEL && config->splitter == DT_SPLIT_ABS_ERROR) {
+        puts("Config condition DT_SPLIT_ABS_ERROR is not supported with DT_GROWTH_LEVEL");
+        return 0;
+    }
+
+    return 1;
+}
+
+int decision_tree_validate_config(DTTrainConfig config)
+{
+    return validate_config(&config);
+}
+
+// Returns the number of attributes each split considers, or 0 for all of them
+static int get_max_features(DTTrainConfig* config, int num_attr)
+{
+    int max_features;
+
+    if (config->feature_sampling == DT_FEATURES_COUNT)
+        max_features = config->max_features;
+    else if (config->feature_sampling == DT_FEATURES_FRACTION)
+        max_features = config->max_features * num_attr;
+    else if (config->feature_sampling == DT_FEATURES_SQRT)
+        max_features = sqrtf(num_attr);
+    else
+        return 0;
+
+    return (max_features < 1) ? 1 : max_features;
+}
+
+// A dataset, if given, holds the data and labels along with their label ids, which the params
+// borrow
+static DTTrainParams* params_create(DecisionTree* dt, DTData* data, void* labels, DTDataset* dataset, float* weights, Bitset* bitset, int* num_threads)
+{
+    DTTrainParams* params;
+
+    *num_threads = 1;
+    params = malloc(sizeof(DTTrainParams));
+    params->config = &dt->config;
+    params->data = data;
+    params->dataset = dataset;
+    params->labels = (int*)labels;
+    params->label_ids = NULL;
+    params->num_unique_labels = 0;
+    params->unique_labels = NULL;
+    params->num_stats = 3;
+    if (dt->config.type == DT_CLASSIFIER && dataset != NULL) {
+        params->num_unique_labels = dataset->num_unique_labels;
+        params->unique_labels = dataset->unique_labels;
+        params->label_ids = dataset->label_ids;
+        params->num_stats = 1 + params->num_unique_labels;
+    } else if (dt->config.type == DT_CLASSIFIER) {
+        params->num_unique_labels = get_num_unique_labels(data->num_rows, labels);
+        params->unique_labels = get_unique_labels(params->num_unique_labels, data->num_rows, labels);
+        params->label_ids = get_label_ids(params->num_unique_labels, params->unique_labels, data->num_rows, labels);
+        params->num_stats = 1 + params->num_unique_labels;
+    }
+    params->weights = weights;
+    params->xlog2x = NULL;
+    params->xlog2x_size = 0;
+    if (dt->config.type == DT_CLASSIFIER && dt->config.splitter == DT_SPLIT_ENTROPY) {
+        params->xlog2x_size = (data->num_rows < DT_XLOG2X_SIZE) ? data->num_rows + 1 : DT_XLOG2X_SIZE;
+        params->xlog2x = xlog2x_create(params->xlog2x_size);
+    }
+    params->feature_types = dt->feature_types;
+    set_kernel(params, &dt->config);
+    params->max_features = get_max_features(&dt->config, data->num_attr);
+    params->rng = dt->config.seed;
+    params->bitset = bitset;
+    params->depth = 0;
+    params->thread_mutex = NULL;
+    params->num_threads_ptr = num_threads;
+    params->num_threads_mutex = malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(params->num_threads_mutex, NULL);
+
+    return params;
+}
+
+static void params_destroy(DTTrainParams* params)
+{
+    free(params->xlog2x);
+    pthread_mutex_destroy(params->num_threads_mutex);
+    if (params->dataset == NULL) {
+        free(params->unique_labels);
+        free(params->label_ids);
+    }
+    free(params->num_threads_mutex);
+    free(params);
+}
+
+// Ordinal attributes are bucketed by counting and categories index the bits of a mask, so
+// both must be small non-negative integers
+static int validate_feature_types(DecisionTree* dt, DTData* data)
+{
+    int attr_idx, label_idx;
+    float value;
+
+    if (dt->feature_types == NULL)
+        return 1;
+
+    for (attr_idx = 0; attr_idx < data->num_attr; attr_idx++) {
+        if (dt->feature_types[attr_idx] != DT_FEATURE_ORDINAL && dt->feature_types[attr_idx] != DT_FEATURE_CATEGORICAL)
+            continue;
+        for (label_idx = 0; label_idx < data->num_rows; label_idx++) {
+            value = get_value(data, attr_idx, label_idx);
+            if (!isnan(value) && (value < 0 || value >= DT_MAX_LEVELS || value != (int)value)) {
+                printf("Ordinal or categorical attribute %d must hold integers between 0 and %d\n", attr_idx, DT_MAX_LEVELS - 1);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Row i has weight weights[i] and rows with a weight of 0 are left out of the root. weights may
+// be NULL for all 1. dataset is NULL unless data and labels are a prepared dataset's
+static void train(DecisionTree* dt, DTData* data, void* labels, DTDataset* dataset, float* weights, int verbose)
+{
+    DTTrainParams* params;
+    Bitset* bitset;
+    int num_threads, label_idx;
+
+    if (!validate_config(&dt->config))
+        return;
+
+    if (dt->config.growth == DT_GROWTH_LEVEL && data->attr == NULL) {
+        puts("Config growth DT_GROWTH_LEVEL needs dense attributes");
+        return;
+    }
+
+    if (data->row_major && dt->config.splitter == DT_SPLIT_ABS_ERROR) {
+        puts("Config condition DT_SPLIT_ABS_ERROR is not supported out of core");
+        return;
+    }
+
+    if (!data->row_major && !validate_feature_types(dt, data))
+        return;
+
+    if (dt->root != NULL)
+        dtnode_destroy(dt->root);
+
+    bitset = bitset_create(data->num_rows);
+    if (weights == NULL) {
+        bitset_setall(bitset);
+    } else {
+        for (label_idx = 0; label_idx < data->num_rows; label_idx++)
+            if (weights[label_idx] > 0)
+                bitset_set(bitset, label_idx);
+    }
+
+    params = params_create(dt, data, labels, dataset, weights, bitset, &num_threads);
+
+    if (verbose)
+        puts("Training decision tree");
+    clock_t t = clock();
+    if (dt->config.growth == DT_GROWTH_LEVEL || data->row_major)
+        dt->root = train_level_wise(params, NULL);
+    else if (dt->config.growth == DT_GROWTH_BEST)
+        dt->root = train_best_first(params);
+    else
+        dt->root = decision_tree_train_helper(params);
+    t = clock() - t;
+    if (verbose)
+        printf("Trained in %f s\n", ((double)t)/CLOCKS_PER_SEC);
+
+    params_destroy(params);
+    bitset_destroy(bitset);
+}
+
+static int validate_attr_type(DTEnum attr_type)
+{
+    int attr_type_valid = (
+            attr_type == DT_ATTR_FLOAT
+        ||  attr_type == DT_ATTR_UINT8
+        ||  attr_type == DT_ATTR_UINT16
+    );
+    if (!attr_type_valid) {
+        puts("Attribute type must be DT_ATTR_FLOAT, DT_ATTR_UINT8, or DT_ATTR_UINT16");
+        return 0;
+    }
+    return 1;
+}
+
+void decision_tree_train(DecisionTree* dt, int num_labels, float* attr, void* labels)
+{
+    decision_tree_train_typed(dt, num_labels, DT_ATTR_FLOAT, attr, labels);
+}
+
+void decision_tree_train_rows(DecisionTree* dt, int num_labels, float* attr, void* labels, int num_rows, int* rows)
+{
+    DTData data;
+    int* row_labels;
+    int i;
+
+    for (i = 0; i < num_rows; i++) {
+        if (rows[i] < 0 || rows[i] >= num_labels) {
+            puts("Row indices must be between 0 and num_labels - 1");
+            return;
+        }
+    }
+
+    // only the selected rows are gathered, straight into feature-major order
+    data_init_dense(&data, num_rows, dt->num_attr, DT_ATTR_FLOAT, transpose(num_rows, dt->num_attr, DT_ATTR_FLOAT, attr, rows), 1);
+    data.owns_attr = 1;
+    row_labels = malloc(num_rows * sizeof(int));
+    for (i = 0; i < num_rows; i++)
+        row_labels[i] = ((int*)labels)[rows[i]];
+
+    train(dt, &data, row_labels, NULL, NULL, 1);
+
+    free(row_labels);
+    data_destroy(&data);
+}
+
+void decision_tree_train_weighted(DecisionTree* dt, int num_labels, float* attr, void* labels, float* weights)
+{
+    DTData data;
+    int label_idx;
+
+    for (label_idx = 0; label_idx < num_labels; label_idx++) {
+        if (!(weights[label_idx] >= 0 && weights[label_idx] < INFINITY)) {
+            puts("Weights must be finite and at least 0");
+            return;
+        }
+    }
+
+    data_init_dense(&data, num_labels, dt->num_attr, DT_ATTR_FLOAT, attr, 0);
+    train(dt, &data, labels, NULL, weights, 1);
+    data_destroy(&data);
+}
+
+// Hashes the bits of a row's attributes and label
+static uint64_t hash_row(int num_attr, float* attr, int label)
+{
+    uint64_t hash;
+    uint32_t bits;
+    int attr_idx;
+
+    hash = (uint32_t)label;
+    for (attr_idx = 0; attr_idx < num_attr; attr_idx++) {
+        memcpy(&bits, attr + attr_idx, sizeof(uint32_t));
+        hash = (hash ^ bits) * 0x100000001B3;
+    }
+    return rng_next(&hash);
+}
+
+int decision_tree_compress(int num_labels, int num_attr, float* attr, void* labels, float* weights, float** unique_attr, void** unique_labels, float** unique_weights)
+{
+    int* row_labels = (int*)labels;
+
+    size_t table_size, slot;
+    int* table;
+    int* ulabels;
+    float* uattr;
+    float* uweights;
+    float* row;
+    int label_idx, num_unique;
+
+    // open addressing over the unique rows found so far, at most half full
+    table_size = 1;
+    while (table_size < 2 * (size_t)num_labels)
+        table_size *= 2;
+    table = malloc(table_size * sizeof(int));
+    memset(table, -1, table_size * sizeof(int));
+
+    uattr = malloc((size_t)num_labels * num_attr * sizeof(float));
+    ulabels = malloc(num_labels * sizeof(int));
+    uweights = malloc(num_labels * sizeof(float));
+    num_unique = 0;
+    for (label_idx = 0; label_idx < num_labels; label_idx++) {
+        row = attr + (size_t)label_idx * num_attr;
+        slot = hash_row(num_attr, row, row_labels[label_idx]) & (table_size - 1);
+        while (table[slot] != -1) {
+            if (ulabels[table[slot]] == row_labels[label_idx] && memcmp(uattr + (size_t)table[slot] * num_attr, row, num_attr * sizeof(float)) == 0)
+                break;
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] != -1) {
+            uweights[table[slot]] += (weights == NULL) ? 1 : weights[label_idx];
+            continue;
+        }
+        table[slot] = num_unique;
+        memcpy(uattr + (size_t)num_unique * num_attr, row, num_attr * sizeof(float));
+        ulabels[num_unique] = row_labels[label_idx];
+        uweights[num_unique] = (weights == NULL) ? 1 : weights[label_idx];
+        num_unique++;
+    }
+    free(table);
+
+    *unique_attr = realloc(uattr, (size_t)num_unique * num_attr * sizeof(float));
+    *unique_labels = realloc(ulabels, num_unique * sizeof(int));
+    *unique_weights = realloc(uweights, num_unique * sizeof(float));
+
+    return num_unique;
+}
+
+void decision_tree_train_typed(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr, void* labels)
+{
+    DTData data;
+    if (!validate_attr_type(attr_type))
+        return;
+    data_init_dense(&data, num_labels, dt->num_attr, attr_type, attr, 0);
+    train(dt, &data, labels, NULL, NULL, 1);
+    data_destroy(&data);
+}
+
+void decision_tree_train_feature_major(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr, void* labels)
+{
+    DTData data;
+    if (!validate_attr_type(attr_type))
+        return;
+    data_init_dense(&data, num_labels, dt->num_attr, attr_type, attr, 1);
+    train(dt, &data, labels, NULL, NULL, 1);
+    data_destroy(&data);
+}
+
+void* decision_tree_feature_major(int num_labels, int num_attr, DTEnum attr_type, void* attr)
+{
+    if (!validate_attr_type(attr_type))
+        return NULL;
+    return transpose(num_labels, num_attr, attr_type, attr, NULL);
+}
+
+void decision_tree_train_bagged(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr, void* labels, float* weights)
+{
+    DTData data;
+    if (!validate_attr_type(attr_type))
+        return;
+    data_init_dense(&data, num_labels, dt->num_attr, attr_type, attr, 1);
+    train(dt, &data, labels, NULL, weights, 0);
+    data_destroy(&data);
+}
+
+void decision_tree_train_out_of_core(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr, void* labels)
+{
+    DTData data;
+    if (!validate_attr_type(attr_type))
+        return;
+    data_init_rows(&data, num_labels, dt->num_attr, attr_type, attr);
+    train(dt, &data, labels, NULL, NULL, 1);
+    data_destroy(&data);
+}
+
+void decision_tree_train_sparse(DecisionTree* dt, int num_labels, int* row_ptr, int* col_idx, float* values, void* labels)
+{
+    DTData data;
+    data_init_sparse(&data, num_labels, dt->num_attr, row_ptr, col_idx, values);
+    train(dt, &data, labels, NULL, NULL, 1);
+    data_destroy(&data);
+}
+
+static DTDataset* dataset_create(int num_labels, int num_attr, DTEnum type, DTEnum attr_type, void* attr, void* labels)
+{
+    DTDataset* ds;
+    DTEntry* entries;
+    int attr_idx, label_idx;
+    int* order;
+
+    ds = malloc(sizeof(DTDataset));
+    ds->type = type;
+    data_init_dense(&ds->data, num_labels, num_attr, attr_type, attr, 0);
+    ds->labels = malloc(num_labels * sizeof(int));
+    memcpy(ds->labels, labels, num_labels * sizeof(int));
+    ds->num_unique_labels = 0;
+    ds->unique_labels = NULL;
+    ds->label_ids = NULL;
+    if (type == DT_CLASSIFIER) {
+        ds->num_unique_labels = get_num_unique_labels(num_labels, ds->labels);
+        ds->unique_labels = get_unique_labels(ds->num_unique_labels, num_labels, ds->labels);
+        ds->label_ids = get_label_ids(ds->num_unique_labels, ds->unique_labels, num_labels, ds->labels);
+    }
+
+    ds->order = NULL;
+    if (attr_type == DT_ATTR_FLOAT) {
+        ds->order = malloc((size_t)num_labels * num_attr * sizeof(int));
+        entries = malloc(num_labels * sizeof(DTEntry));
+        for (attr_idx = 0; attr_idx < num_attr; attr_idx++) {
+            for (label_idx = 0; label_idx < num_labels; label_idx++) {
+                entries[label_idx].value = get_value(&ds->data, attr_idx, label_idx);
+                entries[label_idx].label_idx = label_idx;
+            }
+            qsort(entries, num_labels, sizeof(DTEntry), compare_entries_rows);
+            order = ds->order + (size_t)attr_idx * num_labels;
+            for (label_idx = 0; label_idx < num_labels; label_idx++)
+                order[label_idx] = entries[label_idx].label_idx;
+        }
+        free(entries);
+    }
+
+    ds->bins = NULL;
+    pthread_mutex_init(&ds->mutex, NULL);
+
+    return ds;
+}
+
+DTDataset* decision_tree_dataset_create(int num_labels, int num_attr, DTEnum type, DTEnum attr_type, void* attr, void* labels)
+{
+    DTDataset* ds;
+
+    if (type != DT_CLASSIFIER && type != DT_REGRESSOR) {
+        puts("Dataset type must be DT_CLASSIFIER or DT_REGRESSOR");
+        return NULL;
+    }
+    if (!validate_attr_type(attr_type))
+        return NULL;
+
+    puts("Preparing dataset");
+    clock_t t = clock();
+    ds = dataset_create(num_labels, num_attr, type, attr_type, attr, labels);
+    t = clock() - t;
+    printf("Prepared in %f s\n", ((double)t)/CLOCKS_PER_SEC);
+
+    return ds;
+}
+
+void decision_tree_dataset_destroy(DTDataset* ds)
+{
+    if (ds == NULL)
+        return;
+    if (ds->bins != NULL)
+        bins_destroy(ds->bins);
+    free(ds->bins);
+    pthread_mutex_destroy(&ds->mutex);
+    data_destroy(&ds->data);
+    free(ds->labels);
+    free(ds->unique_labels);
+    free(ds->label_ids);
+    free(ds->order);
+    free(ds);
+}
+
+void decision_tree_train_dataset(DecisionTree* dt, DTDataset* ds)
+{
+    if (dt->config.type != ds->type) {
+        puts("Dataset was prepared for a different decision tree type");
+        return;
+    }
+    if (dt->num_attr != ds->data.num_attr) {
+        puts("Dataset does not have the decision tree's number of attributes");
+        return;
+    }
+    train(dt, &ds->data, ds->labels, ds, NULL, 0);
+}
+
+// Cross-validation jobs, one per (config, fold) pair, numbered config-major and handed to the
+// threads in order. rows is a shuffle of the rows and fold f holds out rows[fold_start[f]] to
+// rows[fold_start[f+1] - 1], which its weights leave out of training. scores[job] is the
+// held-out accuracy or RMSE
+typedef struct {
+    DTDataset*          ds;
+    float*              attr;
+    DTTrainConfig*      configs;
+    int                 num_folds;
+    int*                rows;
+    int*                fold_start;
+    float**             fold_weights;
+    double*             scores;
+    int                 num_jobs;
+    int                 next_job;
+    pthread_mutex_t     mutex;
+} DTCrossVal;
+
+static double cross_validate_score(DTCrossVal* cv, DecisionTree* dt, int fold)
+{
+    DTDataset*  ds          = cv->ds;
+    int         start       = cv->fold_start[fold];
+    int         end         = cv->fold_start[fold+1];
+    int         num_attr    = ds->data.num_attr;
+
+    double res, diff;
+    int label_idx, i;
+
+    res = 0;
+    for (i = start; i < end; i++) {
+        label_idx = cv->rows[i];
+        if (ds->type == DT_CLASSIFIER) {
+            res += decision_tree_classifier_predict(dt, cv->attr + (size_t)label_idx * num_attr) == ((int*)ds->labels)[label_idx];
+        } else {
+            diff = decision_tree_regressor_predict(dt, cv->attr + (size_t)label_idx * num_attr) - ((float*)ds->labels)[label_idx];
+            res += diff * diff;
+        }
+    }
+    res /= end - start;
+
+    return (ds->type == DT_CLASSIFIER) ? res : sqrt(res);
+}
+
+static void* cross_validate_worker(void* void_cv)
+{
+    DTCrossVal* cv = void_cv;
+    DecisionTree* dt;
+    int job, fold;
+
+    for (;;) {
+        pthread_mutex_lock(&cv->mutex);
+        job = cv->next_job++;
+        pthread_mutex_unlock(&cv->mutex);
+        if (job >= cv->num_jobs)
+            break;
+
+        fold = job % cv->num_folds;
+        dt = decision_tree_create(cv->ds->data.num_attr, NULL);
+        decision_tree_config(dt, cv->configs[job / cv->num_folds]);
+        train(dt, &cv->ds->data, cv->ds->labels, cv->ds, cv->fold_weights[fold], 0);
+        cv->scores[job] = cross_validate_score(cv, dt, fold);
+        decision_tree_destroy(dt);
+    }
+
+    return NULL;
+}
+
+DTScore* decision_tree_cross_validate(int num_labels, int num_attr, float* attr, void* labels, int num_folds, int num_configs, DTTrainConfig* configs, int num_threads)
+{
+    DTCrossVal cv;
+    DTScore* res;
+    pthread_t* threads;
+    double avg, var, score;
+    uint64_t rng;
+    int config_idx, fold, label_idx, tmp, i;
+
+    if (num_folds < 2 || num_folds > num_labels) {
+        puts("Number of folds must be at least 2 and at most the number of labels");
+        return NULL;
+    }
+    if (num_configs < 1) {
+        puts("Number of configs must be at least 1");
+        return NULL;
+    }
+    for (config_idx = 0; config_idx < num_configs; config_idx++) {
+        if (!validate_config(&configs[config_idx]))
+            return NULL;
+        if (configs[config_idx].type != configs[0].type) {
+            puts("Configs must all have the same type");
+            return NULL;
+        }
+    }
+    num_threads = (num_threads < 1) ? 1 : num_threads;
+
+    printf("Cross-validating %d configs with %d folds\n", num_configs, num_folds);
+    clock_t t = clock();
+
+    cv.ds = dataset_create(num_labels, num_attr, configs[0].type, DT_ATTR_FLOAT, attr, labels);
+    cv.attr = attr;
+    cv.configs = configs;
+    cv.num_folds = num_folds;
+    cv.rows = malloc(num_labels * sizeof(int));
+    cv.fold_start = malloc((num_folds + 1) * sizeof(int));
+    cv.fold_weights = malloc(num_folds * sizeof(float*));
+    rng = configs[0].seed;
+    for (label_idx = 0; label_idx < num_labels; label_idx++)
+        cv.rows[label_idx] = label_idx;
+    for (label_idx = num_labels - 1; label_idx > 0; label_idx--) {
+        i = rng_next(&rng) % (label_idx + 1);
+        tmp = cv.rows[label_idx];
+        cv.rows[label_idx] = cv.rows[i];
+        cv.rows[i] = tmp;
+    }
+    for (fold = 0; fold <= num_folds; fold++)
+        cv.fold_start[fold] = (size_t)fold * num_labels / num_folds;
+    for (fold = 0; fold < num_folds; fold++) {
+        cv.fold_weights[fold] = malloc(num_labels * sizeof(float));
+        for (label_idx = 0; label_idx < num_labels; label_idx++)
+            cv.fold_weights[fold][label_idx] = 1;
+        for (i = cv.fold_start[fold]; i < cv.fold_start[fold+1]; i++)
+            cv.fold_weights[fold][cv.rows[i]] = 0;
+    }
+    cv.num_jobs = num_configs * num_folds;
+    cv.next_job = 0;
+    cv.scores = malloc(cv.num_jobs * sizeof(double));
+    pthread_mutex_init(&cv.mutex, NULL);
+
+    threads = malloc(num_threads * sizeof(pthread_t));
+    for (i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, cross_validate_worker, &cv);
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    res = malloc(num_configs * sizeof(DTScore));
+    for (config_idx = 0; config_idx < num_configs; config_idx++) {
+        avg = var = 0;
+        for (fold = 0; fold < num_folds; fold++)
+            avg += cv.scores[config_idx * num_folds + fold];
+        avg /= num_folds;
+        for (fold = 0; fold < num_folds; fold++) {
+            score = cv.scores[config_idx * num_folds + fold];
+            var += (score - avg) * (score - avg);
+        }
+        res[config_idx].mean = avg;
+        res[config_idx].variance = var / num_folds;
+    }
+
+    t = clock() - t;
+    printf("Cross-validated in %f s\n", ((double)t)/CLOCKS_PER_SEC);
+
+    free(threads);
+    pthread_mutex_destroy(&cv.mutex);
+    free(cv.scores);
+    for (fold = 0; fold < num_folds; fold++)
+        free(cv.fold_weights[fold]);
+    free(cv.fold_weights);
+    free(cv.fold_start);
+    free(cv.rows);
+    decision_tree_dataset_destroy(cv.ds);
+
+    return res;
+}
+
+// How far the labels of a node's rows moved once the new rows are counted: the total variation
+// distance between the class frequencies before and after for classifiers, and how far the mean
+// moved in standard deviations of the labels before for regressors
+static float get_drift(DTTrainParams* params, double* old_stats, double* stats)
+{
+    double res, old_avg, avg, std;
+    int uniq_idx;
+
+    if (stats[0] == old_stats[0])
+        return 0;
+    if (old_stats[0] == 0)
+        return INFINITY;
+
+    if (params->config->type == DT_CLASSIFIER) {
+        res = 0;
+        for (uniq_idx = 0; uniq_idx < params->num_unique_labels; uniq_idx++)
+            res += fabs(old_stats[1 + uniq_idx] / old_stats[0] - stats[1 + uniq_idx] / stats[0]);
+        return res / 2;
+    }
+
+    old_avg = old_stats[1] / old_stats[0];
+    avg = stats[1] / stats[0];
+    std = old_stats[2] / old_stats[0] - old_avg * old_avg;
+    std = (std > 0) ? sqrt(std) : 0;
+    if (std == 0)
+        return (avg == old_avg) ? 0 : INFINITY;
+    return fabs(avg - old_avg) / std;
+}
+
+// Walks the tree with the rows that reach each node, in params->bitset. A node whose labels
+// drifted past tolerance is regrown from its rows, a leaf that did not takes the label or mean
+// of all of its rows, and a split node that did not passes its rows on. Children draw from
+// their parent's generator like in depth-first growth. Returns the number of subtrees regrown
+static int refit_node(DTTrainParams* params, DTNode* node, int num_old_labels, float tolerance)
+{
+    DTTrainParams child_params;
+    Bitset* bitset_left;
+    Bitset* bitset_right;
+    DTNode* regrown;
+    double* stats;
+    double* old_stats;
+    int label_idx, num_regrown;
+
+    stats = calloc(params->num_stats, sizeof(double));
+    old_stats = calloc(params->num_stats, sizeof(double));
+    for (label_idx = 0; label_idx < params->data->num_rows; label_idx++) {
+        if (!bitset_isset(params->bitset, label_idx))
+            continue;
+        params->add_stats(params, stats, label_idx);
+        if (label_idx < num_old_labels)
+            params->add_stats(params, old_stats, label_idx);
+    }
+
+    num_regrown = 0;
+    if (get_drift(params, old_stats, stats) > tolerance) {
+        regrown = decision_tree_train_helper(params);
+        dtnode_destroy(node->left);
+        dtnode_destroy(node->right);
+        free(node->categories);
+        *node = *regrown;
+        free(regrown);
+        num_regrown = 1;
+    } else if (dtnode_isleaf(node)) {
+        if (stats[0] > 0)
+            set_leaf(params, node, stats);
+    } else {
+        bitset_left = bitset_create(params->data->num_rows);
+        bitset_right = bitset_create(params->data->num_rows);
+        split(params, node, bitset_left, bitset_right);
+        child_params = *params;
+        child_params.depth = params->depth + 1;
+        child_params.bitset = bitset_left;
+        child_params.rng = rng_next(&params->rng);
+        num_regrown += refit_node(&child_params, node->left, num_old_labels, tolerance);
+        child_params.bitset = bitset_right;
+        child_params.rng = rng_next(&params->rng);
+        num_regrown += refit_node(&child_params, node->right, num_old_labels, tolerance);
+        bitset_destroy(bitset_left);
+        bitset_destroy(bitset_right);
+    }
+
+    free(stats);
+    free(old_stats);
+
+    return num_regrown;
+}
+
+void decision_tree_refit(DecisionTree* dt, int num_labels, float* attr, void* labels, int num_old_labels, float tolerance)
+{
+    DTTrainParams* params;
+    Bitset* bitset;
+    DTData data;
+    int num_threads, num_regrown;
+
+    if (dt->root == NULL) {
+        decision_tree_train(dt, num_labels, attr, labels);
+        return;
+    }
+
+    if (!validate_config(&dt->config))
+        return;
+
+    if (num_old_labels < 0 || num_old_labels > num_labels) {
+        puts("Number of old labels must be between 0 and the number of labels");
+        return;
+    }
+
+    if (!(tolerance >= 0)) {
+        puts("Refit tolerance must be at least 0");
+        return;
+    }
+
+    data_init_dense(&data, num_labels, dt->num_attr, DT_ATTR_FLOAT, attr, 0);
+    if (!validate_feature_types(dt, &data)) {
+        data_destroy(&data);
+        return;
+    }
+    bitset = bitset_create(num_labels);
+    bitset_setall(bitset);
+    params = params_create(dt, &data, labels, NULL, NULL, bitset, &num_threads);
+
+    puts("Refitting decision tree");
+    clock_t t = clock();
+    num_regrown = refit_node(params, dt->root, num_old_labels, tolerance);
+    t = clock() - t;
+    printf("Refit in %f s, regrew %d subtrees\n", ((double)t)/CLOCKS_PER_SEC, num_regrown);
+
+    params_destroy(params);
+    bitset_destroy(bitset);
+    data_destroy(&data);
+}
+
+// Merges the unique labels of the workers in shard order and sends them back
+static void cluster_labels(DTCluster* cluster, DTTrainParams* params)
+{
+    int* labels;
+    int num_labels, num_worker_labels, worker_idx;
+
+    num_labels = 0;
+    labels = NULL;
+    for (worker_idx = 0; worker_idx < cluster->num_workers; worker_idx++) {
+        cluster_recv(cluster, worker_idx, &num_worker_labels, sizeof(int));
+        if (num_worker_labels < 0)
+            cluster->failed = 1;
+        if (cluster->failed)
+            break;
+        labels = realloc(labels, (num_labels + num_worker_labels) * sizeof(int));
+        cluster_recv(cluster, worker_idx, labels + num_labels, num_worker_labels * sizeof(int));
+        num_labels += num_worker_labels;
+    }
+
+    params->num_unique_labels = get_num_unique_labels(num_labels, labels);
+    params->unique_labels = get_unique_labels(params->num_unique_labels, num_labels, labels);
+    params->num_stats = 1 + params->num_unique_labels;
+    free(labels);
+
+    cluster_send(cluster, &params->num_unique_labels, sizeof(int));
+    cluster_send(cluster, params->unique_labels, params->num_unique_labels * sizeof(int));
+}
+
+static void cluster_close(DTCluster* cluster)
+{
+    for (int i = 0; i < cluster->num_workers; i++)
+        net_close(cluster->workers[i]);
+    free(cluster->workers);
+}
+
+void decision_tree_train_distributed(DecisionTree* dt, const char* address, int num_workers)
+{
+    int done[2] = { DT_MSG_DONE, 0 };
+    DTTrainParams* params;
+    DTCluster cluster;
+    DTData data;
+    NetSocket* server;
+    NetSocket* sock;
+    DTNode* root;
+    int header[3];
+    int num_rows, worker_idx, i;
+
+    if (!validate_config(&dt->config))
+        return;
+
+    if (dt->config.splitter == DT_SPLIT_ABS_ERROR) {
+        puts("Config condition DT_SPLIT_ABS_ERROR is not supported in distributed training");
+        return;
+    }
+
+    if (num_workers <= 0) {
+        puts("Number of workers must be greater than 0");
+        return;
+    }
+
+    server = net_listen(address);
+    if (server == NULL)
+        return;
+
+    cluster.num_workers = num_workers;
+    cluster.workers = calloc(num_workers, sizeof(NetSocket*));
+    cluster.failed = 0;
+    num_rows = 0;
+    for (i = 0; i < num_workers; i++) {
+        sock = net_accept(server);
+        if (sock == NULL || !net_recv(sock, header, sizeof(header))) {
+            net_close(sock);
+            cluster.failed = 1;
+            break;
+        }
+        worker_idx = header[0];
+        if (worker_idx < 0 || worker_idx >= num_workers || cluster.workers[worker_idx] != NULL || header[2] != dt->num_attr) {
+            printf("Rejected worker %d with %d attributes\n", worker_idx, header[2]);
+            net_close(sock);
+            cluster.failed = 1;
+            break;
+        }
+        cluster.workers[worker_idx] = sock;
+        num_rows += header[1];
+    }
+    net_close(server);
+    if (cluster.failed) {
+        puts("Distributed training failed to connect its workers");
+        cluster_close(&cluster);
+        return;
+    }
 
-    if (num_threads < config->max_num_threads) {
-        new_params->thread_mutex = malloc(sizeof(pthread_mutex_t));
-        pthread_mutex_init(new_params->thread_mutex, NULL);
-        pthread_mutex_lock(new_params->thread_mutex);
-        new_params->bitset = bitset_left;
-        pthread_create(&thid, NULL, decision_tree_train_helper, new_params);
-        pthread_mutex_lock(new_params->thread_mutex);
-        pthread_mutex_destroy(new_params->thread_mutex);
-        free(new_params->thread_mutex);
-        new_params->thread_mutex = NULL;
-        new_params->bitset = bitset_right;
-        node->right = decision_tree_train_helper(new_params);
-        pthread_join(thid, &async_left);
-        node->left = async_left;
-        pthread_mutex_lock(num_threads_mutex);
-        (*num_threads_ptr)--;
-        pthread_mutex_unlock(num_threads_mutex);
+    cluster_send(&cluster, &dt->config, sizeof(DTTrainConfig));
+
+    memset(&data, 0, sizeof(DTData));
+    data.num_attr = dt->num_attr;
+    data.type = DT_ATTR_FLOAT;
+
+    params = calloc(1, sizeof(DTTrainParams));
+    params->config = &dt->config;
+    params->data = &data;
+    params->num_stats = 3;
+    if (dt->config.type == DT_CLASSIFIER)
+        cluster_labels(&cluster, params);
+    params->feature_types = dt->feature_types;
+    set_kernel(params, &dt->config);
+    params->max_features = get_max_features(&dt->config, data.num_attr);
+    params->rng = dt->config.seed;
+
+    printf("Training decision tree on %d rows over %d workers\n", num_rows, num_workers);
+    clock_t t = clock();
+    root = train_level_wise(params, &cluster);
+    cluster_send(&cluster, done, sizeof(done));
+    t = clock() - t;
+
+    if (cluster.failed) {
+        puts("Distributed training failed, a worker disconnected");
+        dtnode_destroy(root);
     } else {
-        new_params->bitset = bitset_left;
-        node->left = decision_tree_train_helper(new_params);
-        new_params->bitset = bitset_right;
-        node->right = decision_tree_train_helper(new_params);
+        printf("Trained in %f s\n", ((double)t)/CLOCKS_PER_SEC);
+        dtnode_destroy(dt->root);
+        dt->root = root;
     }
 
-    bitset_destroy(bitset_left);
-    bitset_destroy(bitset_right);
-    free(new_params);
-
-    return node;
+    cluster_close(&cluster);
+    free(params->unique_labels);
+    free(params);
 }
 
-static int validate_config(DTTrainConfig* config)
+static int worker_labels(NetSocket* sock, DTTrainParams* params)
 {
-    int type_valid = (
-            config->type == DT_CLASSIFIER
-        ||  config->type == DT_REGRESSOR
-    );
-    if (!type_valid) {
-        puts("Config type must be DT_CLASSIFIER or DT_REGRESSOR");
+    int num_rows = params->data->num_rows;
+    int* unique_labels;
+    int num_unique_labels, ok;
+
+    num_unique_labels = get_num_unique_labels(num_rows, params->labels);
+    unique_labels = get_unique_labels(num_unique_labels, num_rows, params->labels);
+    ok = net_send(sock, &num_unique_labels, sizeof(int))
+      && net_send(sock, unique_labels, num_unique_labels * sizeof(int))
+      && net_recv(sock, &params->num_unique_labels, sizeof(int))
+      && params->num_unique_labels >= num_unique_labels;
+    free(unique_labels);
+    if (!ok)
         return 0;
-    }
 
-    int classifier_condition_valid = (
-            config->splitter == DT_SPLIT_ENTROPY
-        ||  config->splitter == DT_SPLIT_GINI
-        ||  config->splitter == DT_SPLIT_ERROR
-    );
-    if (config->type == DT_CLASSIFIER && !classifier_condition_valid) {
-        puts("Config condition for classifier must be DT_SPLIT_ENTROPY, DT_SPLIT_GINI, or DT_SPLIT_ERROR");
+    params->unique_labels = malloc(params->num_unique_labels * sizeof(int));
+    if (!net_recv(sock, params->unique_labels, params->num_unique_labels * sizeof(int)))
         return 0;
+    params->label_ids = get_label_ids(params->num_unique_labels, params->unique_labels, num_rows, params->labels);
+    params->num_stats = 1 + params->num_unique_labels;
+    return 1;
+}
+
+// Sends the unique values of each attribute and bins the rows with the edges that come back
+static int worker_bins(NetSocket* sock, DTBins* bins, DTData* data)
+{
+    int header[2];
+    float* values;
+    float value;
+    int attr_idx, label_idx, num_values, num_unique, ok, i;
+
+    bins->num_rows = data->num_rows;
+    bins->num_attr = data->num_attr;
+    bins->data = data;
+    bins->codes = malloc((size_t)data->num_rows * data->num_attr * sizeof(uint8_t));
+    bins->owns_codes = 1;
+    bins->num_bins = malloc(data->num_attr * sizeof(int));
+    bins->edges = malloc((size_t)data->num_attr * DT_NUM_BINS * sizeof(float));
+    bins->exact = malloc(data->num_attr * sizeof(uint8_t));
+
+    ok = 1;
+    values = malloc(data->num_rows * sizeof(float));
+    for (attr_idx = 0; attr_idx < data->num_attr && ok; attr_idx++) {
+        num_values = 0;
+        for (label_idx = 0; label_idx < data->num_rows; label_idx++) {
+            value = get_value(data, attr_idx, label_idx);
+            if (!isnan(value))
+                values[num_values++] = value;
+        }
+        qsort(values, num_values, sizeof(float), compare_floats);
+        num_unique = 0;
+        for (i = 0; i < num_values; i++)
+            if (num_unique == 0 || values[i] != values[num_unique-1])
+                values[num_unique++] = values[i];
+        header[0] = num_unique;
+        header[1] = 1;
+        if (num_unique > DT_NET_MAX_VALUES) {
+            for (i = 0; i < DT_NET_MAX_VALUES; i++)
+                values[i] = values[(size_t)i * num_unique / DT_NET_MAX_VALUES];
+            header[0] = DT_NET_MAX_VALUES;
+            header[1] = 0;
+        }
+        ok = net_send(sock, header, sizeof(header)) && net_send(sock, values, header[0] * sizeof(float));
+    }
+    free(values);
+
+    ok = ok
+      && net_recv(sock, bins->num_bins, data->num_attr * sizeof(int))
+      && net_recv(sock, bins->edges, (size_t)data->num_attr * DT_NUM_BINS * sizeof(float))
+      && net_recv(sock, bins->exact, data->num_attr * sizeof(uint8_t));
+    for (attr_idx = 0; attr_idx < data->num_attr && ok; attr_idx++) {
+        if (bins->num_bins[attr_idx] < 1 || bins->num_bins[attr_idx] > DT_NUM_BINS)
+            return 0;
+        for (label_idx = 0; label_idx < data->num_rows; label_idx++)
+            bins->codes[get_attr_idx(data->num_rows, attr_idx, label_idx)] = get_bin(bins->num_bins[attr_idx], bins->edges + (size_t)attr_idx * DT_NUM_BINS, get_value(data, attr_idx, label_idx));
     }
 
-    int regressor_condition_valid = (
-            config->splitter == DT_SPLIT_MSE
-        ||  config->splitter == DT_SPLIT_ABS_ERROR
-    );
+    return ok;
+}
 
-    if (config->type == DT_REGRESSOR && !regressor_condition_valid) {
-        puts("Config condition for regressor must be DT_SPLIT_RMSE or DT_SPLIT_ABS_ERROR");
+// Builds the histograms of the pairs the coordinator lists over the worker's rows, with the
+// pairs spread over max_num_threads threads, and sends them back
+static int worker_hist(NetSocket* sock, DTLevel* level, int num_pairs)
+{
+    DTTrainConfig*  config      = level->params->config;
+    DTBins*         bins        = level->bins;
+    int             num_stats   = level->params->num_stats;
+    int             num_nodes   = level->num_nodes;
+
+    DTPassParams* passes;
+    pthread_t* threads;
+    DTPair* pairs;
+    double* hist;
+    int* msg;
+    int* node_pairs;
+    int num_threads, node_idx, attr_idx, ok, i;
+    size_t size;
+
+    if (num_pairs < 0)
+        return 0;
+    msg = malloc(2 * (size_t)num_pairs * sizeof(int));
+    if (!net_recv(sock, msg, 2 * (size_t)num_pairs * sizeof(int))) {
+        free(msg);
         return 0;
     }
 
-    if (config->min_samples_split < 2) {
-        puts("Config minimum samples split must be at least 2");
+    // pairs come sorted by node
+    ok = 1;
+    pairs = malloc(num_pairs * sizeof(DTPair));
+    node_pairs = calloc(num_nodes + 1, sizeof(int));
+    size = 0;
+    for (i = 0; i < num_pairs && ok; i++) {
+        node_idx = msg[2*i];
+        attr_idx = msg[2*i+1];
+        ok = node_idx >= 0 && node_idx < num_nodes && attr_idx >= 0 && attr_idx < bins->num_attr
+          && (i == 0 || node_idx >= pairs[i-1].node_idx);
+        if (!ok)
+            break;
+        pairs[i] = (DTPair) { node_idx, attr_idx, attr_idx, size };
+        size += (size_t)bins->num_bins[attr_idx] * num_stats;
+        node_pairs[node_idx + 1]++;
+    }
+    free(msg);
+    if (!ok) {
+        free(pairs);
+        free(node_pairs);
         return 0;
     }
+    for (node_idx = 0; node_idx < num_nodes; node_idx++)
+        node_pairs[node_idx+1] += node_pairs[node_idx];
+
+    hist = calloc(size, sizeof(double));
+    num_threads = (config->max_num_threads > 1) ? config->max_num_threads : 1;
+    threads = malloc(num_threads * sizeof(pthread_t));
+    passes = malloc(num_threads * sizeof(DTPassParams));
+    for (i = 0; i < num_threads; i++) {
+        passes[i] = (DTPassParams) { level, pairs, node_pairs, 0, 0, hist, NULL };
+        passes[i].start = (size_t)num_pairs * i / num_threads;
+        passes[i].end = (size_t)num_pairs * (i + 1) / num_threads;
+    }
+    for (i = 1; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, level_pass_worker, &passes[i]);
+    level_pass_worker(&passes[0]);
+    for (i = 1; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
 
-    if (config->max_depth <= 0) {
-        puts("Config max depth must be greater than 0");
+    ok = net_send(sock, hist, size * sizeof(double));
+
+    free(passes);
+    free(threads);
+    free(hist);
+    free(pairs);
+    free(node_pairs);
+
+    return ok;
+}
+
+// Moves the worker's rows down to the next level's num_next nodes and sends back their stats
+static int worker_route(NetSocket* sock, DTLevel* level, int num_next)
+{
+    int             num_stats   = level->params->num_stats;
+    int             num_nodes   = level->num_nodes;
+
+    DTSplit* best;
+    double* next_stats;
+    int* msg;
+    int* child_of;
+    int node_idx, ok;
+
+    if (num_next < 0)
         return 0;
+    msg = malloc(DT_ROUTE_SIZE * (size_t)num_nodes * sizeof(int));
+    child_of = malloc(num_nodes * sizeof(int));
+    ok = net_recv(sock, msg, DT_ROUTE_SIZE * (size_t)num_nodes * sizeof(int));
+    for (node_idx = 0; node_idx < num_nodes && ok; node_idx++) {
+        best = &level->nodes[node_idx].best;
+        child_of[node_idx] = msg[DT_ROUTE_SIZE*node_idx];
+        best->attr_idx = msg[DT_ROUTE_SIZE*node_idx+1];
+        best->bin = msg[DT_ROUTE_SIZE*node_idx+2];
+        best->discrete = msg[DT_ROUTE_SIZE*node_idx+3];
+        best->categorical = msg[DT_ROUTE_SIZE*node_idx+4];
+        memcpy(best->right_bins, msg + DT_ROUTE_SIZE*node_idx + 5, sizeof(best->right_bins));
+        ok = child_of[node_idx] == -1
+          || (child_of[node_idx] >= 0 && child_of[node_idx] + 1 < num_next && best->attr_idx >= 0 && best->attr_idx < level->bins->num_attr);
     }
+    free(msg);
 
-    if (config->max_num_threads <= 0) {
-        puts("Config max num threads must be greater than 0");
-        return 0;
+    if (ok) {
+        next_stats = calloc((size_t)num_next * num_stats, sizeof(double));
+        level_route(level, child_of, next_stats);
+        ok = net_send(sock, next_stats, (size_t)num_next * num_stats * sizeof(double));
+        free(next_stats);
     }
+    free(child_of);
 
-    return 1;
+    free(level->nodes);
+    level->nodes = malloc(num_next * sizeof(DTLevelNode));
+    level->num_nodes = num_next;
+
+    return ok;
 }
 
-void decision_tree_train(DecisionTree* dt, int num_labels, float* attr, void* labels)
+void decision_tree_train_worker(const char* address, int worker_idx, int num_labels, int num_attr, float* attr, void* labels)
 {
-    Bitset* bitset = bitset_create(num_labels);
-    bitset_setall(bitset);
-    if (dt->root != NULL)
-        dtnode_destroy(dt->root);
-    DTTrainParams* params = malloc(sizeof(DTTrainParams));
-    int num_threads = 1;
-    params->config = &dt->config;
-    if (!validate_config(params->config)) {
-        free(params);
+    int header[3] = { worker_idx, num_labels, num_attr };
+    DTTrainConfig config;
+    DTTrainParams params;
+    DTData data;
+    DTBins bins;
+    DTLevel level;
+    NetSocket* sock;
+    double* stats;
+    int msg[2];
+    int label_idx, ok;
+
+    sock = net_connect(address, DT_NET_TIMEOUT);
+    if (sock == NULL)
         return;
-    }
-    params->num_attr = dt->num_attr;
-    params->num_labels = num_labels;;
-    params->labels = (int*)labels;
-    params->num_unique_labels = get_num_unique_labels(num_labels, labels);
-    params->unique_labels = get_unique_labels(params->num_unique_labels, num_labels, labels);
-    params->attr = attr;
-    params->bitset = bitset;
-    params->depth = 0;
-    params->thread_mutex = NULL;
-    params->num_threads_ptr = &num_threads;
-    params->num_threads_mutex = malloc(sizeof(pthread_mutex_t));
-    pthread_mutex_init(params->num_threads_mutex, NULL);
 
-    puts("Training decision tree");
-    clock_t t = clock();
-    dt->root = decision_tree_train_helper(params);
-    t = clock() - t;
-    printf("Trained in %f s\n", ((double)t)/CLOCKS_PER_SEC);
-
-    pthread_mutex_destroy(params->num_threads_mutex);
-    free(params->unique_labels);
-    free(params->num_threads_mutex);
-    free(params);
-    bitset_destroy(bitset);
+    data_init_rows(&data, num_labels, num_attr, DT_ATTR_FLOAT, attr);
+    memset(&params, 0, sizeof(DTTrainParams));
+    params.config = &config;
+    params.data = &data;
+    params.labels = labels;
+    params.num_stats = 3;
+
+    ok = net_send(sock, header, sizeof(header))
+      && net_recv(sock, &config, sizeof(DTTrainConfig));
+    if (ok && config.type == DT_CLASSIFIER)
+        ok = worker_labels(sock, &params);
+    if (!ok) {
+        puts("Lost connection to the coordinator");
+        free(params.unique_labels);
+        free(params.label_ids);
+        net_close(sock);
+        return;
+    }
+    set_kernel(&params, &config);
+
+    memset(&level, 0, sizeof(DTLevel));
+    level.params = &params;
+    level.bins = &bins;
+    ok = worker_bins(sock, &bins, &data);
+
+    // every row starts in the root
+    level.node_of = calloc(num_labels, sizeof(int));
+    level.num_nodes = 1;
+    level.nodes = malloc(sizeof(DTLevelNode));
+    stats = calloc(params.num_stats, sizeof(double));
+    for (label_idx = 0; label_idx < num_labels; label_idx++)
+        params.add_stats(&params, stats, label_idx);
+    ok = ok && net_send(sock, stats, params.num_stats * sizeof(double));
+    free(stats);
+
+    while (ok) {
+        ok = net_recv(sock, msg, sizeof(msg));
+        if (!ok || msg[0] == DT_MSG_DONE)
+            break;
+        if (msg[0] == DT_MSG_HIST)
+            ok = worker_hist(sock, &level, msg[1]);
+        else if (msg[0] == DT_MSG_ROUTE)
+            ok = worker_route(sock, &level, msg[1]);
+        else
+            ok = 0;
+    }
+    if (!ok)
+        puts("Lost connection to the coordinator");
+
+    free(level.nodes);
+    free(level.node_of);
+    bins_destroy(&bins);
+    free(params.unique_labels);
+    free(params.label_ids);
+    data_destroy(&data);
+    net_close(sock);
 }
 
 void decision_tree_destroy(DecisionTree* dt)
@@ -702,22 +4340,61 @@ void decision_tree_destroy(DecisionTree* dt)
         for (int i = 0; i < dt->num_attr; i++)
             free(dt->attr_names[i]);
     free(dt->attr_names);
+    free(dt->feature_types);
     dtnode_destroy(dt->root);
     free(dt); 
 }
 
 static void* decision_tree_predict(DecisionTree* dt, float* attr)
 {
-    int (*cmp)(float, float);
     int attr_idx;
     float value;
     DTNode* cur = dt->root;
 
     while (!dtnode_isleaf(cur)) {
-        cmp = (cur->discrete) ? cmp_discrete : cmp_continuous;
         attr_idx = cur->attr_idx;
         value = attr[attr_idx];
-        if (cmp(cur->base, value))
+        if (dtnode_goes_right(cur, value))
+            cur = cur->right;
+        else
+            cur = cur->left;
+    }
+
+    return &cur->label;
+}
+
+static void* decision_tree_predict_typed(DecisionTree* dt, DTEnum attr_type, void* attr)
+{
+    float value;
+    DTNode* cur = dt->root;
+
+    while (!dtnode_isleaf(cur)) {
+        value = get_typed_value(attr_type, attr, cur->attr_idx);
+        if (dtnode_goes_right(cur, value))
+            cur = cur->right;
+        else
+            cur = cur->left;
+    }
+
+    return &cur->label;
+}
+
+static float get_sparse_row_value(int nnz, int* col_idx, float* values, int attr_idx)
+{
+    for (int j = 0; j < nnz; j++)
+        if (col_idx[j] == attr_idx)
+            return values[j];
+    return 0;
+}
+
+static void* decision_tree_predict_sparse(DecisionTree* dt, int nnz, int* col_idx, float* values)
+{
+    float value;
+    DTNode* cur = dt->root;
+
+    while (!dtnode_isleaf(cur)) {
+        value = get_sparse_row_value(nnz, col_idx, values, cur->attr_idx);
+        if (dtnode_goes_right(cur, value))
             cur = cur->right;
         else
             cur = cur->left;
@@ -728,8 +4405,7 @@ static void* decision_tree_predict(DecisionTree* dt, float* attr)
 
 static void* decision_tree_predict_verbose(DecisionTree* dt, float* attr)
 {
-    int (*cmp)(float, float);
-    int attr_idx;
+    int attr_idx, right;
     float value;
     DTNode* cur = dt->root;
     const char* eq;
@@ -738,16 +4414,16 @@ static void* decision_tree_predict_verbose(DecisionTree* dt, float* attr)
     char buf[32];
 
     while (!dtnode_isleaf(cur)) {
-        cmp = (cur->discrete) ? cmp_discrete : cmp_continuous;
         attr_idx = cur->attr_idx;
         value = attr[attr_idx];
+        right = dtnode_goes_right(cur, value);
 
         if (cur->discrete)
             eq = "==";
         else
             eq = "<=";
 
-        if (cmp(cur->base, value))
+        if (right)
             res = "Yes";
         else
             res = "No";
@@ -759,9 +4435,12 @@ static void* decision_tree_predict_verbose(DecisionTree* dt, float* attr)
             name = buf;
         }
 
-        printf("Is %20s = %8.4f %s %8.4f? %s\n", name, value, eq, cur->base, res);
+        if (cur->categories != NULL)
+            printf("Is %20s = %8.4f one of the split's categories? %s\n", name, value, res);
+        else
+            printf("Is %20s = %8.4f %s %8.4f? %s\n", name, value, eq, cur->base, res);
 
-        if (cmp(cur->base, value))
+        if (right)
             cur = cur->right;
         else
             cur = cur->left;
@@ -814,6 +4493,162 @@ float* decision_tree_regressor_test(DecisionTree* dt, int num_labels, float* att
     return predictions;
 }
 
+int* decision_tree_classifier_test_rows(DecisionTree* dt, float* attr, int num_rows, int* rows)
+{
+    int* predictions = malloc(num_rows * sizeof(int));
+    for (int i = 0; i < num_rows; i++)
+        predictions[i] = decision_tree_classifier_predict(dt, attr + (size_t)rows[i] * dt->num_attr);
+    return predictions;
+}
+
+float* decision_tree_regressor_test_rows(DecisionTree* dt, float* attr, int num_rows, int* rows)
+{
+    float* predictions = malloc(num_rows * sizeof(float));
+    for (int i = 0; i < num_rows; i++)
+        predictions[i] = decision_tree_regressor_predict(dt, attr + (size_t)rows[i] * dt->num_attr);
+    return predictions;
+}
+
+int decision_tree_classifier_predict_typed(DecisionTree* dt, DTEnum attr_type, void* attr)
+{
+    if (dt->root == NULL)
+        return 0;
+    return *(int*)decision_tree_predict_typed(dt, attr_type, attr);
+}
+
+float decision_tree_regressor_predict_typed(DecisionTree* dt, DTEnum attr_type, void* attr)
+{
+    if (dt->root == NULL)
+        return 0;
+    return *(float*)decision_tree_predict_typed(dt, attr_type, attr);
+}
+
+int* decision_tree_classifier_test_typed(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr)
+{
+    int row_size = dt->num_attr * get_attr_type_size(attr_type);
+    int* predictions = malloc(num_labels * sizeof(int));
+    for (int i = 0; i < num_labels; i++)
+        predictions[i] = decision_tree_classifier_predict_typed(dt, attr_type, (char*)attr + (size_t)i * row_size);
+    return predictions;
+}
+
+float* decision_tree_regressor_test_typed(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr)
+{
+    int row_size = dt->num_attr * get_attr_type_size(attr_type);
+    float* predictions = malloc(num_labels * sizeof(float));
+    for (int i = 0; i < num_labels; i++)
+        predictions[i] = decision_tree_regressor_predict_typed(dt, attr_type, (char*)attr + (size_t)i * row_size);
+    return predictions;
+}
+
+int decision_tree_classifier_predict_sparse(DecisionTree* dt, int nnz, int* col_idx, float* values)
+{
+    if (dt->root == NULL)
+        return 0;
+    return *(int*)decision_tree_predict_sparse(dt, nnz, col_idx, values);
+}
+
+float decision_tree_regressor_predict_sparse(DecisionTree* dt, int nnz, int* col_idx, float* values)
+{
+    if (dt->root == NULL)
+        return 0;
+    return *(float*)decision_tree_predict_sparse(dt, nnz, col_idx, values);
+}
+
+int* decision_tree_classifier_test_sparse(DecisionTree* dt, int num_labels, int* row_ptr, int* col_idx, float* values)
+{
+    int* predictions = malloc(num_labels * sizeof(int));
+    for (int i = 0; i < num_labels; i++)
+        predictions[i] = decision_tree_classifier_predict_sparse(dt, row_ptr[i+1]-row_ptr[i], col_idx+row_ptr[i], values+row_ptr[i]);
+    return predictions;
+}
+
+float* decision_tree_regressor_test_sparse(DecisionTree* dt, int num_labels, int* row_ptr, int* col_idx, float* values)
+{
+    float* predictions = malloc(num_labels * sizeof(float));
+    for (int i = 0; i < num_labels; i++)
+        predictions[i] = decision_tree_regressor_predict_sparse(dt, row_ptr[i+1]-row_ptr[i], col_idx+row_ptr[i], values+row_ptr[i]);
+    return predictions;
+}
+
+// Split nodes store the direction of missing values in the second bit of discrete, so files
+// written before it read as sending them left. The third bit marks a categorical split, whose
+// categories follow the node
+static int get_discrete_flags(DTNode* node)
+{
+    if (dtnode_isleaf(node))
+        return node->discrete;
+    return node->discrete | (node->missing_right << 1) | ((node->categories != NULL) << 2);
+}
+
+static void set_discrete_flags(DTNode* node, int flags)
+{
+    node->discrete = (flags < 0) ? flags : flags & 1;
+    node->missing_right = (flags < 0) ? 0 : (flags >> 1) & 1;
+    node->num_categories = 0;
+    node->categories = NULL;
+}
+
+static void write_categories(FILE* fptr, DTNode* node)
+{
+    if (node->categories == NULL)
+        return;
+    fwrite(&node->num_categories, sizeof(int), 1, fptr);
+    fwrite(node->categories, sizeof(uint64_t), (node->num_categories + 63) / 64, fptr);
+}
+
+static void read_categories(FILE* fptr, DTNode* node, int flags)
+{
+    if (flags < 0 || !((flags >> 2) & 1))
+        return;
+    fread(&node->num_categories, sizeof(int), 1, fptr);
+    node->categories = malloc(((node->num_categories + 63) / 64) * sizeof(uint64_t));
+    fread(node->categories, sizeof(uint64_t), (node->num_categories + 63) / 64, fptr);
+}
+
+// Model files start with DT_FILE_MAGIC and the size of the config that follows. Config fields
+// are only ever appended, so a smaller config leaves the rest at their defaults and the end of a
+// larger one is skipped. Files from before the header hold the first config of 20 bytes: type,
+// splitter, min_samples_split, max_depth and max_num_threads
+#define DT_FILE_MAGIC       0x31465444
+
+static void write_config(FILE* fptr, DTTrainConfig* config)
+{
+    int header[2] = { DT_FILE_MAGIC, sizeof(DTTrainConfig) };
+    fwrite(header, sizeof(int), 2, fptr);
+    fwrite(config, sizeof(DTTrainConfig), 1, fptr);
+}
+
+// Returns 0 if the file ends before the config does
+static int read_config(FILE* fptr, DTTrainConfig* config)
+{
+    int header[2], fields[5];
+    size_t size;
+
+    *config = decision_tree_default_config();
+    if (fread(header, sizeof(int), 1, fptr) != 1)
+        return 0;
+
+    if (header[0] != DT_FILE_MAGIC) {
+        fields[0] = header[0];
+        if (fread(fields + 1, sizeof(int), 4, fptr) != 4)
+            return 0;
+        config->type = fields[0];
+        config->splitter = fields[1];
+        config->min_samples_split = fields[2];
+        config->max_depth = fields[3];
+        config->max_num_threads = fields[4];
+        return 1;
+    }
+
+    if (fread(header + 1, sizeof(int), 1, fptr) != 1 || header[1] < 0)
+        return 0;
+    size = ((size_t)header[1] < sizeof(DTTrainConfig)) ? (size_t)header[1] : sizeof(DTTrainConfig);
+    if (fread(config, 1, size, fptr) != size)
+        return 0;
+    return fseek(fptr, header[1] - size, SEEK_CUR) == 0;
+}
+
 static int get_num_nodes(DTNode* node)
 {
     if (node == NULL) return 0;
@@ -824,11 +4659,13 @@ static void write_preorder(FILE* fptr, DTNode* node, int* idx, DTNode** preorder
 {
     if (node == NULL)
         return;
+    int flags = get_discrete_flags(node);
     preorder[(*idx)++] = node;
     fwrite(&node->base, sizeof(int), 1, fptr);
     fwrite(&node->attr_idx, sizeof(int), 1, fptr);
-    fwrite(&node->discrete, sizeof(int), 1, fptr);
+    fwrite(&flags, sizeof(int), 1, fptr);
     fwrite(&node->label, sizeof(int), 1, fptr);
+    write_categories(fptr, node);
     write_preorder(fptr, node->left, idx, preorder);
     write_preorder(fptr, node->right, idx, preorder);
 }
@@ -845,6 +4682,30 @@ static void write_inorder(FILE* fptr, DTNode* node, DTNode** preorder)
     write_inorder(fptr, node->right, preorder);
 }
 
+static void write_nodes(FILE* fptr, DTNode* node)
+{
+    int flags;
+    fwrite(&node->attr_idx, sizeof(int), 1, fptr);
+    if (dtnode_isleaf(node)) {
+        fwrite(&node->label, sizeof(int), 1, fptr);
+        return;
+    }
+    flags = get_discrete_flags(node);
+    fwrite(&flags, sizeof(int), 1, fptr);
+    fwrite(&node->base, sizeof(float), 1, fptr);
+    write_categories(fptr, node);
+    write_nodes(fptr, node->left);
+    write_nodes(fptr, node->right);
+}
+
+void decision_tree_write_nodes(DecisionTree* dt, FILE* fptr)
+{
+    int is_trained = dt->root != NULL;
+    fwrite(&is_trained, sizeof(int), 1, fptr);
+    if (is_trained)
+        write_nodes(fptr, dt->root);
+}
+
 void decision_tree_write(DecisionTree* dt, const char* path)
 {
     int i, n, m, idx;
@@ -862,7 +4723,7 @@ void decision_tree_write(DecisionTree* dt, const char* path)
         return;
     }
 
-    fwrite(&dt->config, sizeof(DTTrainConfig), 1, fptr);
+    write_config(fptr, &dt->config);
     fwrite(&dt->num_attr, sizeof(int), 1, fptr);
     n = (dt->attr_names == NULL) ? 0 : dt->num_attr;
     fwrite(&n, sizeof(int), 1, fptr);
@@ -929,9 +4790,44 @@ static DTNode* construct_tree(DTNode** preorder, int* inorder, int pl, int pr, i
     return root;
 }
 
+static DTNode* read_nodes(FILE* fptr)
+{
+    DTNode* node = malloc(sizeof(DTNode));
+    int flags;
+    node->left = node->right = NULL;
+    node->base = 0;
+    node->discrete = -1;
+    node->missing_right = 0;
+    node->num_categories = 0;
+    node->categories = NULL;
+    fread(&node->attr_idx, sizeof(int), 1, fptr);
+    if (node->attr_idx < 0) {
+        fread(&node->label, sizeof(int), 1, fptr);
+        return node;
+    }
+    fread(&flags, sizeof(int), 1, fptr);
+    set_discrete_flags(node, flags);
+    fread(&node->base, sizeof(float), 1, fptr);
+    read_categories(fptr, node, flags);
+    node->left = read_nodes(fptr);
+    node->right = read_nodes(fptr);
+    return node;
+}
+
+DecisionTree* decision_tree_read_nodes(FILE* fptr, int num_attr, DTTrainConfig config)
+{
+    int is_trained;
+    DecisionTree* dt = decision_tree_create(num_attr, NULL);
+    dt->config = config;
+    fread(&is_trained, sizeof(int), 1, fptr);
+    if (is_trained)
+        dt->root = read_nodes(fptr);
+    return dt;
+}
+
 DecisionTree* decision_tree_read(const char* path)
 {
-    int i, n;
+    int i, n, flags;
     DTNode* node;
     DTNode** preorder;
     int* inorder;
@@ -944,7 +4840,13 @@ DecisionTree* decision_tree_read(const char* path)
     }
 
     dt = malloc(sizeof(DecisionTree));
-    fread(&dt->config, sizeof(DTTrainConfig), 1, fptr);
+    dt->feature_types = NULL;
+    if (!read_config(fptr, &dt->config)) {
+        printf("Invalid decision tree file: %s\n", path);
+        free(dt);
+        fclose(fptr);
+        return NULL;
+    }
     read_attr_names(fptr, dt);
     fread(&n, sizeof(int), 1, fptr);
     preorder = malloc(n * sizeof(DTNode*));
@@ -952,8 +4854,10 @@ DecisionTree* decision_tree_read(const char* path)
         node = malloc(sizeof(DTNode));
         fread(&node->base, sizeof(int), 1, fptr);
         fread(&node->attr_idx, sizeof(int), 1, fptr);
-        fread(&node->discrete, sizeof(int), 1, fptr);
+        fread(&flags, sizeof(int), 1, fptr);
+        set_discrete_flags(node, flags);
         fread(&node->label, sizeof(int), 1, fptr);
+        read_categories(fptr, node, flags);
         preorder[i] = node;
     }
     inorder = malloc(n * sizeof(int));
@@ -963,5 +4867,6 @@ DecisionTree* decision_tree_read(const char* path)
 
     free(preorder);
     free(inorder);
+    fclose(fptr);
     return dt;
 }
@@ -1,7 +1,11 @@
 #ifndef DECISIONTREE_H
 #define DECISIONTREE_H
 
+#include <stdint.h>
+#include <stdio.h>
+
 typedef struct DecisionTree DecisionTree;
+typedef struct DTDataset DTDataset;
 
 typedef enum {
 
@@ -18,14 +22,47 @@ typedef enum {
     DT_SPLIT_MSE,
     DT_SPLIT_ABS_ERROR,
 
+    // Attribute element types
+    DT_ATTR_FLOAT,
+    DT_ATTR_UINT8,
+    DT_ATTR_UINT16,
+
+    // Attributes considered per split
+    DT_FEATURES_ALL,
+    DT_FEATURES_COUNT,
+    DT_FEATURES_FRACTION,
+    DT_FEATURES_SQRT,
+
+    // Tree growth strategies
+    DT_GROWTH_DEPTH,
+    DT_GROWTH_LEVEL,
+    DT_GROWTH_BEST,
+
+    // Feature types
+    DT_FEATURE_AUTO,
+    DT_FEATURE_CONTINUOUS,
+    DT_FEATURE_ORDINAL,
+    DT_FEATURE_CATEGORICAL,
+
 } DTEnum;
 
 typedef struct {
-    DTEnum  type;
-    DTEnum  splitter;
-    int     min_samples_split;
-    int     max_depth;
-    int     max_num_threads;
+    float           mean;
+    float           variance;
+} DTScore;
+
+typedef struct {
+    DTEnum          type;
+    DTEnum          splitter;
+    int             min_samples_split;
+    int             max_depth;
+    int             max_num_threads;
+    int             num_random_splits;
+    DTEnum          feature_sampling;
+    float           max_features;
+    unsigned int    seed;
+    DTEnum          growth;
+    int             max_leaf_nodes;
 } DTTrainConfig;
 
 // Create a decision tree with the default config and num_attr names, specified in attr_names
@@ -40,15 +77,61 @@ void            decision_tree_destroy(DecisionTree* dt);
 DecisionTree*   decision_tree_read(const char* path);
 void            decision_tree_write(DecisionTree* dt, const char* path);
 
+// Read and write only the nodes of a decision tree at the current position of an open file,
+// in preorder without the inorder indices. Used to store many trees in one file
+void            decision_tree_write_nodes(DecisionTree* dt, FILE* fptr);
+DecisionTree*   decision_tree_read_nodes(FILE* fptr, int num_attr, DTTrainConfig config);
+
 // Refit the decision tree to new attributes. Forgets old tree.
 void            decision_tree_set_attr(DecisionTree* dt, int num_attr, const char** attr_names);
 
+// Declares the type of each of the num_attr attributes for the trees trained from now on. The
+// array is copied, and NULL makes every attribute DT_FEATURE_AUTO:
+//      DT_FEATURE_AUTO         a value against the rest where few values reach a node, or a
+//                              threshold otherwise
+//      DT_FEATURE_CONTINUOUS   any float, split on a threshold
+//      DT_FEATURE_ORDINAL      integers from 0 to 65535, split on a threshold
+//      DT_FEATURE_CATEGORICAL  integers from 0 to 65535, split on a set of categories against
+//                              the rest. Categories a node never saw go left. Level-wise, out
+//                              of core and distributed, beyond 256 categories neighbouring
+//                              ids share a bin and always go the same way
+// Any attribute may be NaN when missing. Training in memory rejects ordinal or categorical
+// values out of range. Types can be inferred from csv_column_type before csv_encode: CSV_STRING
+// columns are categorical, CSV_INT ordinal and CSV_FLOAT continuous
+void            decision_tree_set_feature_types(DecisionTree* dt, const DTEnum* feature_types);
+
 // Returns the default config:
 //      type = DT_CLASSIFIER
 //      condition = DT_SPLIT_ENTROPY
 //      min_samples_split = 2
 //      max_depth = 8
 //      max_num_threads = 1
+//      num_random_splits = 0
+//      feature_sampling = DT_FEATURES_ALL
+//      max_features = 1
+//      seed = 0
+//      growth = DT_GROWTH_DEPTH
+//      max_leaf_nodes = 0
+// With num_random_splits = 0 every unique value of an attribute is tried as a split. Otherwise
+// only num_random_splits thresholds drawn uniformly between the attribute's min and max in each
+// node are tried (extremely randomized trees), which avoids sorting and suits large,
+// mostly continuous data, especially in ensembles
+// DT_SPLIT_ABS_ERROR scores each side of a split by the weighted mean absolute deviation of
+// its labels from their median, and its leaves predict the weighted median. The split search
+// keeps running medians of both sides in two heaps, in O(n log n) per attribute
+// feature_sampling limits the attributes each split considers to a random subset of
+// max_features of them (DT_FEATURES_COUNT), a max_features fraction of them
+// (DT_FEATURES_FRACTION), or the square root of num_attr (DT_FEATURES_SQRT), drawn anew at
+// every node. Random choices come from seed, and a tree trained with the same config and data is
+// the same regardless of max_num_threads
+// growth = DT_GROWTH_DEPTH grows one node at a time, each scanning its own rows. DT_GROWTH_LEVEL
+// grows one depth at a time: every attribute is quantized into at most 256 bins once, and each
+// level builds the bin histograms of all of its nodes in one sequential pass per attribute,
+// split over max_num_threads threads. Attributes with at most 256 unique values split exactly
+// as with DT_GROWTH_DEPTH. It needs dense attributes and does not support DT_SPLIT_ABS_ERROR
+// DT_GROWTH_BEST always splits the leaf whose split decreases the weighted impurity the most,
+// until the tree has max_leaf_nodes leaves (0 for no limit) or max_depth stops it. It spends
+// the node budget on the splits that help most, for smaller trees at the same accuracy
 DTTrainConfig   decision_tree_default_config(void);
 
 // Sets the config for the current decision tree
@@ -60,19 +143,164 @@ void            decision_tree_config(DecisionTree* dt, DTTrainConfig config);
 // num_labels is the number of labels used for testing
 // attr is a num_labels * num_attr flattened 2D array. each row corresponds to the element in labels
 // labels can be either an integer array or a float array for classifiers or regressors respectively
+// Float attributes may be missing (NaN). Each split sends the rows missing its attribute to the
+// side where they score best, and prediction sends missing values the same way. Trees grown
+// level-wise, out of core or distributed bin missing values with the lowest values instead
 void            decision_tree_train(DecisionTree* dt, int num_labels, float* attr, void* labels);
 
+// Trains the decision tree on the num_rows rows rows[0], ..., rows[num_rows-1] of attr, a
+// num_labels * num_attr array, and their labels, as if they had been copied out in that order
+// Rows may repeat, so subsets, permutations and bootstrap samples need only their indices
+void            decision_tree_train_rows(DecisionTree* dt, int num_labels, float* attr, void* labels, int num_rows, int* rows);
+
+// Trains the decision tree with attributes and labels as in decision_tree_train, where row i
+// has weight weights[i] as if it appeared weights[i] times. Every split condition and leaf
+// weighs the rows, and rows with a weight of 0 are left out. Weights must be finite and at
+// least 0
+void            decision_tree_train_weighted(DecisionTree* dt, int num_labels, float* attr, void* labels, float* weights);
+
+// Collapses the rows of attr and labels, as in decision_tree_train, that have the same bits in
+// every attribute and label into one row weighing as much as all of them, weights[i] each or 1
+// if weights is NULL. The unique rows are put in the order they first appear in *unique_attr,
+// *unique_labels and *unique_weights, for decision_tree_train_weighted. Hashing the rows takes
+// one pass. Returns the number of unique rows. You are responsible for freeing memory
+int             decision_tree_compress(int num_labels, int num_attr, float* attr, void* labels, float* weights, float** unique_attr, void** unique_labels, float** unique_weights);
+
+// Trains the decision tree with attributes of type attr_type (DT_ATTR_FLOAT, DT_ATTR_UINT8, or
+// DT_ATTR_UINT16) so that integer data such as pixels does not have to be widened to floats
+// Integer attributes are split searched with a counting histogram over their values
+void            decision_tree_train_typed(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr, void* labels);
+
+// Dense attributes are copied into feature-major order once before training so that each
+// attribute is scanned sequentially. If attr is already feature-major, i.e. a num_attr * num_labels
+// array where row i holds attribute i of every label, this skips the copy
+void            decision_tree_train_feature_major(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr, void* labels);
+
+// Returns a feature-major copy of a num_labels * num_attr attribute matrix
+// You are responsible for freeing memory
+void*           decision_tree_feature_major(int num_labels, int num_attr, DTEnum attr_type, void* attr);
+
+// Trains the decision tree for an ensemble, quietly. attr is feature-major as in
+// decision_tree_train_feature_major. Row i has weight weights[i] in every split score and leaf,
+// and rows with a weight of 0 are left out. weights may be NULL for all 1
+void            decision_tree_train_bagged(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr, void* labels, float* weights);
+
+// Trains the decision tree on a row-major num_labels * num_attr attribute matrix of type
+// attr_type that does not need to fit in memory, such as a memory-mapped file (see idx.h)
+// The tree is grown level-wise whatever the config's growth, reading the rows in order once per
+// pass. Each level takes a pass for its histograms, or more if they exceed a fixed budget, and
+// one to move the rows down. Bin edges come from a sample of evenly spaced rows. Apart from
+// the labels, memory use is a few bytes per row
+void            decision_tree_train_out_of_core(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr, void* labels);
+
+// Trains the decision tree with attributes in compressed sparse row (CSR) format
+// Row i has the values values[j] in the attributes col_idx[j] for row_ptr[i] <= j < row_ptr[i+1]
+// and 0 in every other attribute. row_ptr has num_labels + 1 elements
+// Rows that are 0 in an attribute are handled together, so split search scales with the number
+// of nonzeros rather than num_labels * num_attr
+void            decision_tree_train_sparse(DecisionTree* dt, int num_labels, int* row_ptr, int* col_idx, float* values, void* labels);
+
+// Prepares a dataset once for training any number of decision trees of type type (DT_CLASSIFIER
+// or DT_REGRESSOR) on it. attr is a row-major num_labels * num_attr array of type attr_type and
+// labels are as in decision_tree_train; both are copied. The attributes are stored
+// feature-major, classifier labels are mapped to ids, and the rows of each float attribute are
+// sorted by value so that no split search sorts again. Sorting takes 4 more bytes per value
+// Bins for DT_GROWTH_LEVEL are built by the first tree grown level-wise
+DTDataset*      decision_tree_dataset_create(int num_labels, int num_attr, DTEnum type, DTEnum attr_type, void* attr, void* labels);
+
+// Destroy a dataset
+void            decision_tree_dataset_destroy(DTDataset* ds);
+
+// Trains the decision tree on a dataset, quietly. The tree is the one decision_tree_train_typed
+// grows on the same rows. The dataset is only read, so any number of trees can be trained on it
+// at the same time from different threads
+void            decision_tree_train_dataset(DecisionTree* dt, DTDataset* ds);
+
+// Cross-validates each of num_configs configs with num_folds folds. The rows are shuffled with
+// the first config's seed and dealt into folds of equal size. attr and labels are as in
+// decision_tree_train and the configs must all have the same type. The data is prepared once as
+// a dataset and a fold is a mask over its rows rather than a copy. Level-wise growth bins each
+// fold's training rows only, so held-out rows never place bin edges. The num_configs *
+// num_folds trainings are spread over num_threads threads, each training with its config's
+// max_num_threads
+// Returns the mean and variance over the folds of the held-out accuracy for classifiers or
+// RMSE for regressors, for each config in order. You are responsible for freeing memory
+DTScore*        decision_tree_cross_validate(int num_labels, int num_attr, float* attr, void* labels, int num_folds, int num_configs, DTTrainConfig* configs, int num_threads);
+
+// Refits a trained decision tree after rows were appended to its training data. attr and
+// labels hold all num_labels rows, of which the first num_old_labels are the ones the tree was
+// trained on. Every node is given the rows that now reach it. A node whose labels drifted by
+// more than tolerance is regrown depth-first from its rows with the current config, and only
+// its subtree is searched again. The leaves of the rest take the label or mean of all of their
+// rows. Classifiers measure drift as the total variation distance between a node's class
+// frequencies before and after the new rows, from 0 to 1, and regressors as how far its mean
+// moved in standard deviations of its labels before. Nodes that had no rows always drift
+// An untrained decision tree is trained on all rows
+void            decision_tree_refit(DecisionTree* dt, int num_labels, float* attr, void* labels, int num_old_labels, float tolerance);
+
+// Trains the decision tree on rows sharded over num_workers processes, on this machine or
+// others of the same architecture, each calling decision_tree_train_worker with the same
+// address: "host:port" for TCP or "unix:path" for a Unix-domain socket (see net.h). The
+// coordinator listens on address, holds no rows, and grows the tree level-wise whatever the
+// config's growth: workers send per-node bin histograms and stats, which are summed in shard
+// order, and the coordinator chooses the splits and sends them back. The tree is the one
+// decision_tree_train grows on the shards concatenated in worker_idx order when every attribute
+// has at most 256 unique values and the sums are exact (e.g. classifiers, or integer labels),
+// and otherwise the same as with DT_GROWTH_LEVEL up to rounding. DT_SPLIT_ABS_ERROR is not
+// supported. If a worker disconnects, the decision tree is not altered and a message is printed
+// Distributed training needs POSIX sockets. Elsewhere, such as Windows builds, the coordinator
+// and its workers print that sockets are not supported and return
+void            decision_tree_train_distributed(DecisionTree* dt, const char* address, int num_workers);
+
+// Serves shard worker_idx, from 0 to num_workers - 1, of a distributed training until the
+// coordinator at address finishes, connecting for up to a minute while it is not listening
+// yet. attr is a row-major num_labels * num_attr array and labels are as in
+// decision_tree_train. The worker takes the coordinator's config, and max_num_threads threads
+// build its histograms
+void            decision_tree_train_worker(const char* address, int worker_idx, int num_labels, int num_attr, float* attr, void* labels);
+
 // Test a decision tree. Returns the predictions in an array of size num_labels
+// The _rows versions predict rows rows[0], ..., rows[num_rows-1] of attr, in an array of size num_rows
 int*            decision_tree_classifier_test(DecisionTree* dt, int num_labels, float* attr);
 float*          decision_tree_regressor_test(DecisionTree* dt, int num_labels, float* attr);
+int*            decision_tree_classifier_test_rows(DecisionTree* dt, float* attr, int num_rows, int* rows);
+float*          decision_tree_regressor_test_rows(DecisionTree* dt, float* attr, int num_rows, int* rows);
+int*            decision_tree_classifier_test_typed(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr);
+float*          decision_tree_regressor_test_typed(DecisionTree* dt, int num_labels, DTEnum attr_type, void* attr);
+int*            decision_tree_classifier_test_sparse(DecisionTree* dt, int num_labels, int* row_ptr, int* col_idx, float* values);
+float*          decision_tree_regressor_test_sparse(DecisionTree* dt, int num_labels, int* row_ptr, int* col_idx, float* values);
 
 // Returns the predicted label for a decision tree classifier
 int             decision_tree_classifier_predict(DecisionTree* dt, float* attr);
 int             decision_tree_classifier_predict_verbose(DecisionTree* dt, float* attr);
+int             decision_tree_classifier_predict_typed(DecisionTree* dt, DTEnum attr_type, void* attr);
+int             decision_tree_classifier_predict_sparse(DecisionTree* dt, int nnz, int* col_idx, float* values);
 
 // Returns the predicted value for a decision tree regressor
 float           decision_tree_regressor_predict(DecisionTree* dt, float* attr);
 float           decision_tree_regressor_predict_verbose(DecisionTree* dt, float* attr);
+float           decision_tree_regressor_predict_typed(DecisionTree* dt, DTEnum attr_type, void* attr);
+float           decision_tree_regressor_predict_sparse(DecisionTree* dt, int nnz, int* col_idx, float* values);
+
+// Returns 1 if the config is valid. Otherwise prints why and returns 0
+int             decision_tree_validate_config(DTTrainConfig config);
+
+// Returns the size in bytes of an attribute of type attr_type
+int             decision_tree_attr_type_size(DTEnum attr_type);
+
+// Places the edges of at most max_bins bins, from 1 to 256, from num_values values of an
+// attribute, which are sorted in place, and returns the number of bins. edges must hold max_bins
+// floats. Bin b holds the values in (edges[b-1], edges[b]], and missing values (NaN) fall into
+// the first bin. If the values have at most max_bins unique values, each gets its own bin and
+// exact is set. Otherwise the edges are quantiles
+int             decision_tree_bin_edges(int num_values, float* values, int max_bins, float* edges, int* exact);
+
+// Returns the bin of value among num_bins bins with the given edges
+uint8_t         decision_tree_get_bin(int num_bins, float* edges, float value);
+
+// Returns the next value of the splitmix64 generator with the given state, which it advances
+// Trees and ensembles draw all of their random choices from it
+uint64_t        decision_tree_rng_next(uint64_t* state);
 
 #endif
 
@@ -0,0 +1,422 @@
+#include "gradientboost.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+typedef struct GradientBoost {
+    int num_attr;
+    GBTrainConfig config;
+    int* num_bins;
+    float** edges;
+    float base_score;
+    int num_trees;
+    DecisionTree** trees;
+} GradientBoost;
+
+static void destroy_model(GradientBoost* gb)
+{
+    for (int i = 0; i < gb->num_trees; i++)
+        decision_tree_destroy(gb->trees[i]);
+    free(gb->trees);
+    if (gb->edges != NULL)
+        for (int i = 0; i < gb->num_attr; i++)
+            free(gb->edges[i]);
+    free(gb->edges);
+    free(gb->num_bins);
+    gb->num_trees = 0;
+    gb->trees = NULL;
+    gb->edges = NULL;
+    gb->num_bins = NULL;
+}
+
+GradientBoost* gradient_boost_create(int num_attr)
+{
+    GradientBoost* gb = malloc(sizeof(GradientBoost));
+    gb->num_attr = num_attr;
+    gb->config = gradient_boost_default_config();
+    gb->num_bins = NULL;
+    gb->edges = NULL;
+    gb->base_score = 0;
+    gb->num_trees = 0;
+    gb->trees = NULL;
+    return gb;
+}
+
+void gradient_boost_destroy(GradientBoost* gb)
+{
+    destroy_model(gb);
+    free(gb);
+}
+
+GBTrainConfig gradient_boost_default_config(void)
+{
+    return (GBTrainConfig) {
+        .loss = GB_LOSS_SQUARED,
+        .num_rounds = 100,
+        .learning_rate = 0.1,
+        .max_depth = 6,
+        .min_samples_split = 2,
+        .max_bins = 256,
+        .early_stopping_rounds = 10,
+        .max_num_threads = 1
+    };
+}
+
+void gradient_boost_config(GradientBoost* gb, GBTrainConfig config)
+{
+    gb->config = config;
+}
+
+// Every round trains a regression tree with this config
+static DTTrainConfig get_tree_config(GBTrainConfig* config)
+{
+    DTTrainConfig tree_config = decision_tree_default_config();
+    tree_config.type = DT_REGRESSOR;
+    tree_config.splitter = DT_SPLIT_MSE;
+    tree_config.max_depth = config->max_depth;
+    tree_config.min_samples_split = config->min_samples_split;
+    tree_config.max_num_threads = config->max_num_threads;
+    return tree_config;
+}
+
+static int validate_config(GBTrainConfig* config)
+{
+    int loss_valid = (
+            config->loss == GB_LOSS_SQUARED
+        ||  config->loss == GB_LOSS_LOGISTIC
+    );
+    if (!loss_valid) {
+        puts("Config loss must be GB_LOSS_SQUARED or GB_LOSS_LOGISTIC");
+        return 0;
+    }
+
+    if (config->num_rounds <= 0) {
+        puts("Config num rounds must be greater than 0");
+        return 0;
+    }
+
+    if (config->learning_rate <= 0) {
+        puts("Config learning rate must be greater than 0");
+        return 0;
+    }
+
+    if (config->max_bins < 2 || config->max_bins > 256) {
+        puts("Config max bins must be between 2 and 256");
+        return 0;
+    }
+
+    if (config->early_stopping_rounds < 0) {
+        puts("Config early stopping rounds must be at least 0");
+        return 0;
+    }
+
+    return decision_tree_validate_config(get_tree_config(config));
+}
+
+// Bin b holds the values in (edges[b-1], edges[b]]. If an attribute has at most max_bins unique
+// values, every unique value gets its own bin and the binned splits are exact. Otherwise the
+// edges are quantiles of the attribute. Missing values (NaN) are left out of the edges and fall
+// into the first bin
+static void compute_bins(GradientBoost* gb, int num_labels, float* attr)
+{
+    int attr_idx, label_idx, exact;
+    float* values;
+
+    gb->num_bins = malloc(gb->num_attr * sizeof(int));
+    gb->edges = malloc(gb->num_attr * sizeof(float*));
+    values = malloc(num_labels * sizeof(float));
+
+    for (attr_idx = 0; attr_idx < gb->num_attr; attr_idx++) {
+        for (label_idx = 0; label_idx < num_labels; label_idx++)
+            values[label_idx] = attr[(size_t)label_idx * gb->num_attr + attr_idx];
+        gb->edges[attr_idx] = malloc(gb->config.max_bins * sizeof(float));
+        gb->num_bins[attr_idx] = decision_tree_bin_edges(num_labels, values, gb->config.max_bins, gb->edges[attr_idx], &exact);
+    }
+
+    free(values);
+}
+
+static void bin_row(GradientBoost* gb, float* attr, uint8_t* bins)
+{
+    for (int attr_idx = 0; attr_idx < gb->num_attr; attr_idx++)
+        bins[attr_idx] = decision_tree_get_bin(gb->num_bins[attr_idx], gb->edges[attr_idx], attr[attr_idx]);
+}
+
+static uint8_t* bin_rows(GradientBoost* gb, int num_labels, float* attr)
+{
+    uint8_t* bins = malloc((size_t)num_labels * gb->num_attr * sizeof(uint8_t));
+    for (int label_idx = 0; label_idx < num_labels; label_idx++)
+        bin_row(gb, attr + (size_t)label_idx * gb->num_attr, bins + (size_t)label_idx * gb->num_attr);
+    return bins;
+}
+
+static float sigmoid(float x)
+{
+    return 1 / (1 + expf(-x));
+}
+
+static float get_loss(GBEnum loss, int num_labels, float* scores, float* labels)
+{
+    double res = 0;
+    float p;
+    for (int i = 0; i < num_labels; i++) {
+        if (loss == GB_LOSS_SQUARED) {
+            res += (scores[i] - labels[i]) * (scores[i] - labels[i]);
+        } else {
+            p = sigmoid(scores[i]);
+            p = (p < 1e-7) ? 1e-7 : (p > 1 - 1e-7) ? 1 - 1e-7 : p;
+            res -= labels[i] * logf(p) + (1 - labels[i]) * logf(1 - p);
+        }
+    }
+    return res / num_labels;
+}
+
+void gradient_boost_train(GradientBoost* gb, int num_labels, float* attr, float* labels,
+                          int num_valid, float* valid_attr, float* valid_labels)
+{
+    GBTrainConfig* config = &gb->config;
+    DTTrainConfig tree_config;
+    DecisionTree* tree;
+    uint8_t* bins;
+    uint8_t* bins_feature_major;
+    uint8_t* valid_bins;
+    float* scores;
+    float* valid_scores;
+    float* targets;
+    float* weights;
+    float p, loss, best_loss, mean;
+    int round, best_round, label_idx, num_attr;
+
+    if (!validate_config(config))
+        return;
+
+    destroy_model(gb);
+    num_attr = gb->num_attr;
+
+    puts("Training gradient boosted trees");
+    clock_t t = clock();
+
+    compute_bins(gb, num_labels, attr);
+    bins = bin_rows(gb, num_labels, attr);
+    bins_feature_major = decision_tree_feature_major(num_labels, num_attr, DT_ATTR_UINT8, bins);
+    valid_bins = (num_valid > 0) ? bin_rows(gb, num_valid, valid_attr) : NULL;
+
+    mean = 0;
+    for (label_idx = 0; label_idx < num_labels; label_idx++)
+        mean += labels[label_idx];
+    mean /= num_labels;
+    if (config->loss == GB_LOSS_LOGISTIC) {
+        mean = (mean < 1e-6) ? 1e-6 : (mean > 1 - 1e-6) ? 1 - 1e-6 : mean;
+        gb->base_score = logf(mean / (1 - mean));
+    } else {
+        gb->base_score = mean;
+    }
+
+    scores = malloc(num_labels * sizeof(float));
+    targets = malloc(num_labels * sizeof(float));
+    weights = (config->loss == GB_LOSS_LOGISTIC) ? malloc(num_labels * sizeof(float)) : NULL;
+    valid_scores = (num_valid > 0) ? malloc(num_valid * sizeof(float)) : NULL;
+    for (label_idx = 0; label_idx < num_labels; label_idx++)
+        scores[label_idx] = gb->base_score;
+    for (label_idx = 0; label_idx < num_valid; label_idx++)
+        valid_scores[label_idx] = gb->base_score;
+
+    tree_config = get_tree_config(config);
+    gb->trees = malloc(config->num_rounds * sizeof(DecisionTree*));
+    best_loss = INFINITY;
+    best_round = 0;
+
+    for (round = 0; round < config->num_rounds; round++) {
+        for (label_idx = 0; label_idx < num_labels; label_idx++) {
+            if (config->loss == GB_LOSS_SQUARED) {
+                targets[label_idx] = labels[label_idx] - scores[label_idx];
+            } else {
+                p = sigmoid(scores[label_idx]);
+                weights[label_idx] = (p * (1 - p) > 1e-6) ? p * (1 - p) : 1e-6;
+                targets[label_idx] = (labels[label_idx] - p) / weights[label_idx];
+            }
+        }
+
+        tree = decision_tree_create(num_attr, NULL);
+        decision_tree_config(tree, tree_config);
+        decision_tree_train_bagged(tree, num_labels, DT_ATTR_UINT8, bins_feature_major, targets, weights);
+        gb->trees[gb->num_trees++] = tree;
+
+        for (label_idx = 0; label_idx < num_labels; label_idx++)
+            scores[label_idx] += config->learning_rate * decision_tree_regressor_predict_typed(tree, DT_ATTR_UINT8, bins + (size_t)label_idx * num_attr);
+
+        if (num_valid == 0)
+            continue;
+
+        for (label_idx = 0; label_idx < num_valid; label_idx++)
+            valid_scores[label_idx] += config->learning_rate * decision_tree_regressor_predict_typed(tree, DT_ATTR_UINT8, valid_bins + (size_t)label_idx * num_attr);
+        loss = get_loss(config->loss, num_valid, valid_scores, valid_labels);
+        if (loss < best_loss) {
+            best_loss = loss;
+            best_round = round;
+        } else if (config->early_stopping_rounds > 0 && round - best_round >= config->early_stopping_rounds) {
+            break;
+        }
+    }
+
+    if (num_valid > 0) {
+        while (gb->num_trees > best_round + 1)
+            decision_tree_destroy(gb->trees[--gb->num_trees]);
+        printf("Best validation loss %f after %d rounds\n", best_loss, gb->num_trees);
+    }
+
+    t = clock() - t;
+    printf("Trained %d trees in %f s\n", gb->num_trees, ((double)t)/CLOCKS_PER_SEC);
+
+    free(bins);
+    free(bins_feature_major);
+    free(valid_bins);
+    free(scores);
+    free(valid_scores);
+    free(targets);
+    free(weights);
+}
+
+// Predicts a row, binning it into bins, a buffer of num_attr bytes
+static float predict_row(GradientBoost* gb, float* attr, uint8_t* bins)
+{
+    float score;
+
+    bin_row(gb, attr, bins);
+    score = 0;
+    for (int i = 0; i < gb->num_trees; i++)
+        score += decision_tree_regressor_predict_typed(gb->trees[i], DT_ATTR_UINT8, bins);
+
+    score = gb->base_score + gb->config.learning_rate * score;
+    return (gb->config.loss == GB_LOSS_LOGISTIC) ? sigmoid(score) : score;
+}
+
+float gradient_boost_predict(GradientBoost* gb, float* attr)
+{
+    uint8_t* bins;
+    float score;
+
+    if (gb->trees == NULL)
+        return 0;
+
+    bins = malloc(gb->num_attr * sizeof(uint8_t));
+    score = predict_row(gb, attr, bins);
+    free(bins);
+
+    return score;
+}
+
+float* gradient_boost_test(GradientBoost* gb, int num_labels, float* attr)
+{
+    float* predictions = calloc(num_labels, sizeof(float));
+    uint8_t* bins;
+
+    if (gb->trees == NULL)
+        return predictions;
+
+    bins = malloc(gb->num_attr * sizeof(uint8_t));
+    for (int i = 0; i < num_labels; i++)
+        predictions[i] = predict_row(gb, attr + (size_t)i * gb->num_attr, bins);
+    free(bins);
+
+    return predictions;
+}
+
+// Model files start with GB_FILE_MAGIC and the size of the config that follows. Config fields
+// are only ever appended, so a smaller config leaves the rest at their defaults and the end of a
+// larger one is skipped
+#define GB_FILE_MAGIC 0x31464247
+
+void gradient_boost_write(GradientBoost* gb, const char* path)
+{
+    int header[2] = { GB_FILE_MAGIC, sizeof(GBTrainConfig) };
+    FILE* fptr;
+    int i;
+
+    if (gb->trees == NULL) {
+        puts("Nothing to write for gradient boosted trees");
+        return;
+    }
+
+    fptr = fopen(path, "wb");
+    if (fptr == NULL) {
+        printf("Failed to open path: %s\n", path);
+        return;
+    }
+
+    fwrite(header, sizeof(int), 2, fptr);
+    fwrite(&gb->config, sizeof(GBTrainConfig), 1, fptr);
+    fwrite(&gb->num_attr, sizeof(int), 1, fptr);
+    for (i = 0; i < gb->num_attr; i++) {
+        fwrite(&gb->num_bins[i], sizeof(int), 1, fptr);
+        fwrite(gb->edges[i], sizeof(float), gb->num_bins[i] - 1, fptr);
+    }
+    fwrite(&gb->base_score, sizeof(float), 1, fptr);
+    fwrite(&gb->num_trees, sizeof(int), 1, fptr);
+    for (i = 0; i < gb->num_trees; i++)
+        decision_tree_write_nodes(gb->trees[i], fptr);
+
+    fclose(fptr);
+
+    printf("Successfully wrote gradient boosted trees to %s\n", path);
+}
+
+GradientBoost* gradient_boost_read(const char* path)
+{
+    GradientBoost* gb;
+    DTTrainConfig tree_config;
+    FILE* fptr;
+    int header[2], num_trees, ok, i;
+    size_t size;
+
+    fptr = fopen(path, "rb");
+    if (fptr == NULL) {
+        printf("Could not open %s\n", path);
+        return NULL;
+    }
+
+    // the counts are checked before anything is allocated from them
+    gb = gradient_boost_create(0);
+    ok = fread(header, sizeof(int), 2, fptr) == 2
+      && header[0] == GB_FILE_MAGIC
+      && header[1] >= 0;
+    size = (ok && (size_t)header[1] < sizeof(GBTrainConfig)) ? (size_t)header[1] : sizeof(GBTrainConfig);
+    ok = ok
+      && fread(&gb->config, 1, size, fptr) == size
+      && fseek(fptr, header[1] - size, SEEK_CUR) == 0
+      && fread(&gb->num_attr, sizeof(int), 1, fptr) == 1
+      && gb->num_attr > 0;
+    if (ok) {
+        gb->num_bins = calloc(gb->num_attr, sizeof(int));
+        gb->edges = calloc(gb->num_attr, sizeof(float*));
+    }
+    for (i = 0; ok && i < gb->num_attr; i++) {
+        ok = fread(&gb->num_bins[i], sizeof(int), 1, fptr) == 1
+          && gb->num_bins[i] >= 1 && gb->num_bins[i] <= 256;
+        if (ok) {
+            gb->edges[i] = malloc(gb->num_bins[i] * sizeof(float));
+            ok = fread(gb->edges[i], sizeof(float), gb->num_bins[i] - 1, fptr) == (size_t)(gb->num_bins[i] - 1);
+        }
+    }
+    ok = ok
+      && fread(&gb->base_score, sizeof(float), 1, fptr) == 1
+      && fread(&num_trees, sizeof(int), 1, fptr) == 1
+      && num_trees >= 0;
+    if (!ok) {
+        printf("Invalid gradient boosted trees file: %s\n", path);
+        fclose(fptr);
+        gradient_boost_destroy(gb);
+        return NULL;
+    }
+
+    tree_config = get_tree_config(&gb->config);
+    gb->trees = malloc(num_trees * sizeof(DecisionTree*));
+    for (i = 0; i < num_trees; i++)
+        gb->trees[gb->num_trees++] = decision_tree_read_nodes(fptr, gb->num_attr, tree_config);
+
+    fclose(fptr);
+    return gb;
+}
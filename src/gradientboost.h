@@ -0,0 +1,67 @@
+#ifndef GRADIENTBOOST_H
+#define GRADIENTBOOST_H
+
+#include "decisiontree.h"
+
+typedef struct GradientBoost GradientBoost;
+
+typedef enum {
+
+    // Loss functions
+    GB_LOSS_SQUARED,
+    GB_LOSS_LOGISTIC,
+
+} GBEnum;
+
+typedef struct {
+    GBEnum  loss;
+    int     num_rounds;
+    float   learning_rate;
+    int     max_depth;
+    int     min_samples_split;
+    int     max_bins;
+    int     early_stopping_rounds;
+    int     max_num_threads;
+} GBTrainConfig;
+
+// Create gradient boosted trees over num_attr attributes with the default config
+GradientBoost*  gradient_boost_create(int num_attr);
+
+// Destroy gradient boosted trees
+void            gradient_boost_destroy(GradientBoost* gb);
+
+// Read and write gradient boosted trees to avoid retraining
+GradientBoost*  gradient_boost_read(const char* path);
+void            gradient_boost_write(GradientBoost* gb, const char* path);
+
+// Returns the default config:
+//      loss = GB_LOSS_SQUARED
+//      num_rounds = 100
+//      learning_rate = 0.1
+//      max_depth = 6
+//      min_samples_split = 2
+//      max_bins = 256
+//      early_stopping_rounds = 10
+//      max_num_threads = 1
+GBTrainConfig   gradient_boost_default_config(void);
+
+// Sets the config for the current gradient boosted trees
+void            gradient_boost_config(GradientBoost* gb, GBTrainConfig config);
+
+// Trains one regression tree per round. With GB_LOSS_SQUARED each tree fits the residuals of the
+// trees before it. With GB_LOSS_LOGISTIC labels are 0 or 1 and each tree takes a Newton step on
+// the log loss, fitting -gradient / hessian with the hessians as row weights
+// Attributes are binned into at most max_bins quantile bins once, and every round trains on the
+// binned attributes
+// If num_valid > 0, training stops once the loss on the held-out valid_attr and valid_labels has
+// not improved for early_stopping_rounds rounds, and the trees after the best round are dropped
+void            gradient_boost_train(GradientBoost* gb, int num_labels, float* attr, float* labels,
+                                     int num_valid, float* valid_attr, float* valid_labels);
+
+// Returns the predicted value for GB_LOSS_SQUARED, or the probability of label 1 for GB_LOSS_LOGISTIC
+float           gradient_boost_predict(GradientBoost* gb, float* attr);
+
+// Test gradient boosted trees. Returns the predictions in an array of size num_labels
+float*          gradient_boost_test(GradientBoost* gb, int num_labels, float* attr);
+
+#endif
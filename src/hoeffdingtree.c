@@ -0,0 +1,625 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "hoeffdingtree.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct HTNode HTNode;
+
+// Leaves hold the stats of the rows they have learned, in the same layout as the decision tree
+// trainer: the total weight, then the weight of each class for classifiers, or the sum and sum
+// of squares of the labels for regressors. hist holds those stats per attribute and bin for the
+// rows learned since the leaf was made, and is NULL at max_depth where leaves no longer split.
+// last_check is the total weight when the leaf last tried to split. Split nodes keep neither
+typedef struct HTNode {
+    HTNode* left;
+    HTNode* right;
+    float base;
+    int attr_idx;
+    int depth;
+    double* stats;
+    double* hist;
+    double last_check;
+} HTNode;
+
+typedef struct HoeffdingTree {
+    int num_attr;
+    HTTrainConfig config;
+    HTNode* root;
+    int num_stats;
+    int num_unique_labels;
+    int* unique_labels;
+    int* num_bins;
+    float* edges;
+    int num_warmup;
+    float* warmup_attr;
+    float* warmup_labels;
+    pthread_rwlock_t lock;
+} HoeffdingTree;
+
+static HTNode* node_create(HoeffdingTree* ht, int depth)
+{
+    HTNode* node = malloc(sizeof(HTNode));
+    node->left = NULL;
+    node->right = NULL;
+    node->base = 0;
+    node->attr_idx = -1;
+    node->depth = depth;
+    node->stats = calloc(ht->num_stats, sizeof(double));
+    node->hist = NULL;
+    if (ht->edges != NULL && depth < ht->config.max_depth)
+        node->hist = calloc((size_t)ht->num_attr * ht->config.num_bins * ht->num_stats, sizeof(double));
+    node->last_check = 0;
+    return node;
+}
+
+static void node_destroy(HTNode* node)
+{
+    if (node == NULL)
+        return;
+    node_destroy(node->left);
+    node_destroy(node->right);
+    free(node->stats);
+    free(node->hist);
+    free(node);
+}
+
+static void destroy_model(HoeffdingTree* ht)
+{
+    node_destroy(ht->root);
+    free(ht->unique_labels);
+    free(ht->num_bins);
+    free(ht->edges);
+    free(ht->warmup_attr);
+    free(ht->warmup_labels);
+}
+
+static void forget(HoeffdingTree* ht)
+{
+    destroy_model(ht);
+    ht->num_stats = (ht->config.type == DT_CLASSIFIER) ? 1 : 3;
+    ht->num_unique_labels = 0;
+    ht->unique_labels = NULL;
+    ht->num_bins = NULL;
+    ht->edges = NULL;
+    ht->num_warmup = 0;
+    ht->warmup_attr = NULL;
+    ht->warmup_labels = NULL;
+    ht->root = node_create(ht, 0);
+}
+
+HoeffdingTree* hoeffding_tree_create(int num_attr)
+{
+    HoeffdingTree* ht = malloc(sizeof(HoeffdingTree));
+    ht->num_attr = num_attr;
+    ht->config = hoeffding_tree_default_config();
+    ht->root = NULL;
+    ht->unique_labels = NULL;
+    ht->num_bins = NULL;
+    ht->edges = NULL;
+    ht->warmup_attr = NULL;
+    ht->warmup_labels = NULL;
+    pthread_rwlock_init(&ht->lock, NULL);
+    forget(ht);
+    return ht;
+}
+
+void hoeffding_tree_destroy(HoeffdingTree* ht)
+{
+    destroy_model(ht);
+    pthread_rwlock_destroy(&ht->lock);
+    free(ht);
+}
+
+HTTrainConfig hoeffding_tree_default_config(void)
+{
+    return (HTTrainConfig) {
+        .type = DT_CLASSIFIER,
+        .splitter = DT_SPLIT_ENTROPY,
+        .max_depth = 20,
+        .grace_period = 200,
+        .delta = 1e-7,
+        .tie_threshold = 0.05,
+        .num_bins = 64,
+        .num_warmup_rows = 1000
+    };
+}
+
+static int validate_config(HTTrainConfig* config)
+{
+    int type_valid = (
+            config->type == DT_CLASSIFIER
+        ||  config->type == DT_REGRESSOR
+    );
+    if (!type_valid) {
+        puts("Config type must be DT_CLASSIFIER or DT_REGRESSOR");
+        return 0;
+    }
+
+    int classifier_condition_valid = (
+            config->splitter == DT_SPLIT_ENTROPY
+        ||  config->splitter == DT_SPLIT_GINI
+        ||  config->splitter == DT_SPLIT_ERROR
+    );
+    if (config->type == DT_CLASSIFIER && !classifier_condition_valid) {
+        puts("Config condition for classifier must be DT_SPLIT_ENTROPY, DT_SPLIT_GINI, or DT_SPLIT_ERROR");
+        return 0;
+    }
+
+    if (config->type == DT_REGRESSOR && config->splitter != DT_SPLIT_MSE) {
+        puts("Config condition for regressor must be DT_SPLIT_MSE");
+        return 0;
+    }
+
+    if (config->max_depth <= 0) {
+        puts("Config max depth must be greater than 0");
+        return 0;
+    }
+
+    if (config->grace_period <= 0) {
+        puts("Config grace period must be greater than 0");
+        return 0;
+    }
+
+    if (!(config->delta > 0 && config->delta < 1)) {
+        puts("Config delta must be between 0 and 1");
+        return 0;
+    }
+
+    if (config->tie_threshold < 0) {
+        puts("Config tie threshold must be at least 0");
+        return 0;
+    }
+
+    if (config->num_bins < 2) {
+        puts("Config num bins must be at least 2");
+        return 0;
+    }
+
+    if (config->num_warmup_rows <= 0) {
+        puts("Config num warmup rows must be greater than 0");
+        return 0;
+    }
+
+    return 1;
+}
+
+void hoeffding_tree_config(HoeffdingTree* ht, HTTrainConfig config)
+{
+    pthread_rwlock_wrlock(&ht->lock);
+    if (validate_config(&config)) {
+        ht->config = config;
+        forget(ht);
+    }
+    pthread_rwlock_unlock(&ht->lock);
+}
+
+static int compare_floats(const void* a, const void* b)
+{
+    float value_a = *(float*)a;
+    float value_b = *(float*)b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+// Bin b holds the values in (edges[b-1], edges[b]], and the last bin everything above. If an
+// attribute has at most num_bins unique values in the warmup rows, each gets its own bin.
+// Otherwise the edges are quantiles
+static void compute_bins(HoeffdingTree* ht)
+{
+    int num_bins = ht->config.num_bins;
+    int attr_idx, label_idx, num_unique, num_edges, i;
+    float* values;
+    float* edges;
+    float edge;
+
+    ht->num_bins = malloc(ht->num_attr * sizeof(int));
+    ht->edges = malloc((size_t)ht->num_attr * num_bins * sizeof(float));
+    values = malloc(ht->num_warmup * sizeof(float));
+
+    for (attr_idx = 0; attr_idx < ht->num_attr; attr_idx++) {
+        for (label_idx = 0; label_idx < ht->num_warmup; label_idx++)
+            values[label_idx] = ht->warmup_attr[(size_t)label_idx * ht->num_attr + attr_idx];
+        qsort(values, ht->num_warmup, sizeof(float), compare_floats);
+
+        num_unique = 0;
+        for (label_idx = 0; label_idx < ht->num_warmup; label_idx++)
+            if (num_unique == 0 || values[label_idx] != values[num_unique-1])
+                values[num_unique++] = values[label_idx];
+
+        edges = ht->edges + (size_t)attr_idx * num_bins;
+        num_edges = 0;
+        if (num_unique <= num_bins) {
+            for (i = 0; i + 1 < num_unique; i++)
+                edges[num_edges++] = values[i];
+        } else {
+            for (i = 1; i < num_bins; i++) {
+                edge = values[(size_t)i * num_unique / num_bins - 1];
+                if (num_edges == 0 || edge != edges[num_edges-1])
+                    edges[num_edges++] = edge;
+            }
+        }
+        ht->num_bins[attr_idx] = num_edges + 1;
+    }
+
+    free(values);
+}
+
+static int get_bin(HoeffdingTree* ht, int attr_idx, float value)
+{
+    float* edges = ht->edges + (size_t)attr_idx * ht->config.num_bins;
+    int lo = 0, hi = ht->num_bins[attr_idx] - 1, mid;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (edges[mid] < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Widens the stats of every leaf by one class, after a label is seen for the first time
+static void add_class(HoeffdingTree* ht, HTNode* node, int old_num_stats)
+{
+    double* hist;
+    size_t bin, num_hist_bins;
+
+    if (node->left != NULL) {
+        add_class(ht, node->left, old_num_stats);
+        add_class(ht, node->right, old_num_stats);
+        return;
+    }
+
+    node->stats = realloc(node->stats, ht->num_stats * sizeof(double));
+    node->stats[old_num_stats] = 0;
+    if (node->hist == NULL)
+        return;
+    num_hist_bins = (size_t)ht->num_attr * ht->config.num_bins;
+    hist = calloc(num_hist_bins * ht->num_stats, sizeof(double));
+    for (bin = 0; bin < num_hist_bins; bin++)
+        memcpy(hist + bin * ht->num_stats, node->hist + bin * old_num_stats, old_num_stats * sizeof(double));
+    free(node->hist);
+    node->hist = hist;
+}
+
+static int get_label_id(HoeffdingTree* ht, int label)
+{
+    int uniq_idx;
+
+    for (uniq_idx = 0; uniq_idx < ht->num_unique_labels; uniq_idx++)
+        if (ht->unique_labels[uniq_idx] == label)
+            return uniq_idx;
+
+    ht->unique_labels = realloc(ht->unique_labels, (ht->num_unique_labels + 1) * sizeof(int));
+    ht->unique_labels[ht->num_unique_labels++] = label;
+    ht->num_stats++;
+    add_class(ht, ht->root, ht->num_stats - 1);
+    return uniq_idx;
+}
+
+static void add_stats(HoeffdingTree* ht, double* stats, float label)
+{
+    stats[0] += 1;
+    if (ht->config.type == DT_CLASSIFIER) {
+        stats[1 + (int)label] += 1;
+    } else {
+        stats[1] += label;
+        stats[2] += (double)label * label;
+    }
+}
+
+// Impurity of a set of rows from its stats: entropy, Gini impurity, or the misclassification
+// rate for classifiers, and the variance of the labels for regressors
+static float get_impurity(HoeffdingTree* ht, double* stats)
+{
+    double avg, res, p;
+    int uniq_idx;
+
+    if (stats[0] == 0)
+        return 0;
+
+    if (ht->config.type == DT_REGRESSOR) {
+        avg = stats[1] / stats[0];
+        res = stats[2] / stats[0] - avg * avg;
+        return (res > 0) ? res : 0;
+    }
+
+    res = (ht->config.splitter == DT_SPLIT_ENTROPY) ? 0 : 1;
+    for (uniq_idx = 0; uniq_idx < ht->num_unique_labels; uniq_idx++) {
+        if (stats[1 + uniq_idx] == 0)
+            continue;
+        p = stats[1 + uniq_idx] / stats[0];
+        if (ht->config.splitter == DT_SPLIT_ENTROPY)
+            res -= p * log2(p);
+        else if (ht->config.splitter == DT_SPLIT_GINI)
+            res -= p * p;
+        else
+            res = (res < 1 - p) ? res : 1 - p;
+    }
+    return res;
+}
+
+// Range of the merits compared by the Hoeffding bound. Regressors compare the fraction of the
+// variance a split removes
+static float get_merit_range(HoeffdingTree* ht)
+{
+    if (ht->config.type == DT_CLASSIFIER && ht->config.splitter == DT_SPLIT_ENTROPY)
+        return log2((ht->num_unique_labels > 2) ? ht->num_unique_labels : 2);
+    return 1;
+}
+
+// Sums the leaf's histogram of an attribute over its bins, the stats of the rows binned since
+// the leaf was made. A child starts with the stats of its side of the split but an empty
+// histogram, so splits are only ever scored against these
+static void get_hist_stats(HoeffdingTree* ht, HTNode* leaf, int attr_idx, double* stats)
+{
+    int num_stats = ht->num_stats;
+    double* hist = leaf->hist + (size_t)attr_idx * ht->config.num_bins * num_stats;
+    int bin, j;
+
+    memset(stats, 0, num_stats * sizeof(double));
+    for (bin = 0; bin < ht->num_bins[attr_idx]; bin++)
+        for (j = 0; j < num_stats; j++)
+            stats[j] += hist[bin * num_stats + j];
+}
+
+// Finds the best bin to split an attribute after, from the leaf's histogram and the stats of
+// its binned rows, hist_stats. Returns the merit, the decrease in weighted impurity, or 0 if the
+// attribute does not split the leaf
+static float find_best_bin(HoeffdingTree* ht, HTNode* leaf, int attr_idx, double* hist_stats, float impurity, int* best_bin, double* stats_left, double* stats_right)
+{
+    int num_stats = ht->num_stats;
+    double* hist = leaf->hist + (size_t)attr_idx * ht->config.num_bins * num_stats;
+    float best_merit, merit, score;
+    int bin, j;
+
+    best_merit = 0;
+    *best_bin = -1;
+    memset(stats_left, 0, num_stats * sizeof(double));
+    for (bin = 0; bin + 1 < ht->num_bins[attr_idx]; bin++) {
+        for (j = 0; j < num_stats; j++) {
+            stats_left[j] += hist[bin * num_stats + j];
+            stats_right[j] = hist_stats[j] - stats_left[j];
+        }
+        if (stats_left[0] == 0 || stats_right[0] == 0)
+            continue;
+        score = (stats_left[0] * get_impurity(ht, stats_left) + stats_right[0] * get_impurity(ht, stats_right)) / hist_stats[0];
+        merit = impurity - score;
+        if (ht->config.type == DT_REGRESSOR)
+            merit /= impurity;
+        if (merit > best_merit) {
+            best_merit = merit;
+            *best_bin = bin;
+        }
+    }
+    return best_merit;
+}
+
+// Splits the leaf if the best attribute beats the second best, or not splitting, by more than
+// the Hoeffding bound, sqrt(R^2 ln(1/delta) / 2n), or the bound is below tie_threshold. n is
+// the number of rows binned since the leaf was made. The children start with the stats of the
+// binned rows on their side of the split
+static void try_split(HoeffdingTree* ht, HTNode* leaf)
+{
+    int             num_stats   = ht->num_stats;
+
+    HTNode* child;
+    double* hist_stats;
+    double* stats_left;
+    double* stats_right;
+    double n;
+    float impurity, merit, best_merit, second_merit, range, bound;
+    int attr_idx, bin, best_attr_idx, best_bin, i, j;
+
+    leaf->last_check = leaf->stats[0];
+    hist_stats = malloc(num_stats * sizeof(double));
+    get_hist_stats(ht, leaf, 0, hist_stats);
+    n = hist_stats[0];
+    impurity = get_impurity(ht, hist_stats);
+    if (impurity <= 0) {
+        free(hist_stats);
+        return;
+    }
+
+    stats_left = malloc(num_stats * sizeof(double));
+    stats_right = malloc(num_stats * sizeof(double));
+    best_attr_idx = best_bin = -1;
+    best_merit = second_merit = 0;
+    for (attr_idx = 0; attr_idx < ht->num_attr; attr_idx++) {
+        merit = find_best_bin(ht, leaf, attr_idx, hist_stats, impurity, &bin, stats_left, stats_right);
+        if (merit > best_merit) {
+            second_merit = best_merit;
+            best_merit = merit;
+            best_attr_idx = attr_idx;
+            best_bin = bin;
+        } else if (merit > second_merit) {
+            second_merit = merit;
+        }
+    }
+
+    range = get_merit_range(ht);
+    bound = sqrt(range * range * log(1 / ht->config.delta) / (2 * n));
+    if (best_attr_idx == -1 || !(best_merit - second_merit > bound || bound < ht->config.tie_threshold)) {
+        free(hist_stats);
+        free(stats_left);
+        free(stats_right);
+        return;
+    }
+
+    memset(stats_left, 0, num_stats * sizeof(double));
+    for (bin = 0; bin <= best_bin; bin++)
+        for (j = 0; j < num_stats; j++)
+            stats_left[j] += leaf->hist[((size_t)best_attr_idx * ht->config.num_bins + bin) * num_stats + j];
+
+    for (i = 0; i < 2; i++) {
+        child = node_create(ht, leaf->depth + 1);
+        for (j = 0; j < num_stats; j++)
+            child->stats[j] = (i == 0) ? stats_left[j] : hist_stats[j] - stats_left[j];
+        child->last_check = child->stats[0];
+        if (i == 0)
+            leaf->left = child;
+        else
+            leaf->right = child;
+    }
+    leaf->attr_idx = best_attr_idx;
+    leaf->base = ht->edges[(size_t)best_attr_idx * ht->config.num_bins + best_bin];
+    free(leaf->stats);
+    free(leaf->hist);
+    leaf->stats = NULL;
+    leaf->hist = NULL;
+
+    free(hist_stats);
+    free(stats_left);
+    free(stats_right);
+}
+
+static HTNode* find_leaf(HTNode* node, float* attr)
+{
+    while (node->left != NULL)
+        node = (attr[node->attr_idx] > node->base) ? node->right : node->left;
+    return node;
+}
+
+static void add_hist(HoeffdingTree* ht, HTNode* leaf, float* attr, float label)
+{
+    for (int attr_idx = 0; attr_idx < ht->num_attr; attr_idx++)
+        add_stats(ht, leaf->hist + ((size_t)attr_idx * ht->config.num_bins + get_bin(ht, attr_idx, attr[attr_idx])) * ht->num_stats, label);
+}
+
+// Once the warmup rows are in, places the bin edges and replays the rows into the root's
+// histogram. Their stats are already in the root
+static void end_warmup(HoeffdingTree* ht)
+{
+    int label_idx;
+
+    compute_bins(ht);
+    ht->root->hist = calloc((size_t)ht->num_attr * ht->config.num_bins * ht->num_stats, sizeof(double));
+    for (label_idx = 0; label_idx < ht->num_warmup; label_idx++)
+        add_hist(ht, ht->root, ht->warmup_attr + (size_t)label_idx * ht->num_attr, ht->warmup_labels[label_idx]);
+    if (ht->root->stats[0] >= ht->config.grace_period)
+        try_split(ht, ht->root);
+
+    free(ht->warmup_attr);
+    free(ht->warmup_labels);
+    ht->warmup_attr = NULL;
+    ht->warmup_labels = NULL;
+}
+
+void hoeffding_tree_learn(HoeffdingTree* ht, int num_labels, float* attr, void* labels)
+{
+    HTNode* leaf;
+    float* row;
+    float label;
+    int label_idx;
+
+    pthread_rwlock_wrlock(&ht->lock);
+    for (label_idx = 0; label_idx < num_labels; label_idx++) {
+        row = attr + (size_t)label_idx * ht->num_attr;
+        // classifiers keep the label's id, which fits in a float exactly
+        if (ht->config.type == DT_CLASSIFIER)
+            label = get_label_id(ht, ((int*)labels)[label_idx]);
+        else
+            label = ((float*)labels)[label_idx];
+
+        leaf = find_leaf(ht->root, row);
+        add_stats(ht, leaf->stats, label);
+
+        // a leaf tries to split every grace_period rows
+        if (ht->edges != NULL) {
+            if (leaf->hist == NULL)
+                continue;
+            add_hist(ht, leaf, row, label);
+            if (leaf->stats[0] - leaf->last_check >= ht->config.grace_period)
+                try_split(ht, leaf);
+            continue;
+        }
+
+        if (ht->warmup_attr == NULL) {
+            ht->warmup_attr = malloc((size_t)ht->config.num_warmup_rows * ht->num_attr * sizeof(float));
+            ht->warmup_labels = malloc(ht->config.num_warmup_rows * sizeof(float));
+        }
+        memcpy(ht->warmup_attr + (size_t)ht->num_warmup * ht->num_attr, row, ht->num_attr * sizeof(float));
+        ht->warmup_labels[ht->num_warmup++] = label;
+        if (ht->num_warmup == ht->config.num_warmup_rows)
+            end_warmup(ht);
+    }
+    pthread_rwlock_unlock(&ht->lock);
+}
+
+static int predict_label(HoeffdingTree* ht, float* attr)
+{
+    double* stats = find_leaf(ht->root, attr)->stats;
+    int uniq_idx, most_common_idx;
+
+    if (ht->num_unique_labels == 0)
+        return -1;
+
+    most_common_idx = 0;
+    for (uniq_idx = 1; uniq_idx < ht->num_unique_labels; uniq_idx++)
+        if (stats[1 + uniq_idx] > stats[1 + most_common_idx])
+            most_common_idx = uniq_idx;
+    return ht->unique_labels[most_common_idx];
+}
+
+static float predict_value(HoeffdingTree* ht, float* attr)
+{
+    double* stats = find_leaf(ht->root, attr)->stats;
+    return (stats[0] == 0) ? 0 : stats[1] / stats[0];
+}
+
+int hoeffding_tree_classifier_predict(HoeffdingTree* ht, float* attr)
+{
+    int label;
+    pthread_rwlock_rdlock(&ht->lock);
+    label = predict_label(ht, attr);
+    pthread_rwlock_unlock(&ht->lock);
+    return label;
+}
+
+float hoeffding_tree_regressor_predict(HoeffdingTree* ht, float* attr)
+{
+    float value;
+    pthread_rwlock_rdlock(&ht->lock);
+    value = predict_value(ht, attr);
+    pthread_rwlock_unlock(&ht->lock);
+    return value;
+}
+
+int* hoeffding_tree_classifier_test(HoeffdingTree* ht, int num_labels, float* attr)
+{
+    int* predictions = malloc(num_labels * sizeof(int));
+    pthread_rwlock_rdlock(&ht->lock);
+    for (int i = 0; i < num_labels; i++)
+        predictions[i] = predict_label(ht, attr + (size_t)i * ht->num_attr);
+    pthread_rwlock_unlock(&ht->lock);
+    return predictions;
+}
+
+float* hoeffding_tree_regressor_test(HoeffdingTree* ht, int num_labels, float* attr)
+{
+    float* predictions = malloc(num_labels * sizeof(float));
+    pthread_rwlock_rdlock(&ht->lock);
+    for (int i = 0; i < num_labels; i++)
+        predictions[i] = predict_value(ht, attr + (size_t)i * ht->num_attr);
+    pthread_rwlock_unlock(&ht->lock);
+    return predictions;
+}
+
+static int get_num_nodes(HTNode* node)
+{
+    if (node == NULL)
+        return 0;
+    return 1 + get_num_nodes(node->left) + get_num_nodes(node->right);
+}
+
+int hoeffding_tree_num_nodes(HoeffdingTree* ht)
+{
+    int num_nodes;
+    pthread_rwlock_rdlock(&ht->lock);
+    num_nodes = get_num_nodes(ht->root);
+    pthread_rwlock_unlock(&ht->lock);
+    return num_nodes;
+}
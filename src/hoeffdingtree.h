@@ -0,0 +1,64 @@
+#ifndef HOEFFDINGTREE_H
+#define HOEFFDINGTREE_H
+
+#include "decisiontree.h"
+
+typedef struct HoeffdingTree HoeffdingTree;
+
+typedef struct {
+    DTEnum  type;
+    DTEnum  splitter;
+    int     max_depth;
+    int     grace_period;
+    float   delta;
+    float   tie_threshold;
+    int     num_bins;
+    int     num_warmup_rows;
+} HTTrainConfig;
+
+// Create a streaming decision tree over num_attr attributes with the default config
+HoeffdingTree*  hoeffding_tree_create(int num_attr);
+
+// Destroy a streaming decision tree
+void            hoeffding_tree_destroy(HoeffdingTree* ht);
+
+// Returns the default config:
+//      type = DT_CLASSIFIER
+//      splitter = DT_SPLIT_ENTROPY
+//      max_depth = 20
+//      grace_period = 200
+//      delta = 1e-7
+//      tie_threshold = 0.05
+//      num_bins = 64
+//      num_warmup_rows = 1000
+// type and splitter are as for decision trees, except that DT_SPLIT_ABS_ERROR is not supported
+// A leaf tries to split every grace_period rows. It splits on the best attribute once
+// the Hoeffding bound shows, with probability 1 - delta, that it beats the second best and not
+// splitting, or once the bound falls below tie_threshold and the two are too close to matter
+// Leaves keep a histogram of num_bins bins per attribute. The bin edges are quantiles of the
+// first num_warmup_rows rows, the only rows ever stored
+HTTrainConfig   hoeffding_tree_default_config(void);
+
+// Sets the config for the streaming decision tree and forgets what it has learned. An invalid
+// config is reported and ignored, keeping the current config and model
+void            hoeffding_tree_config(HoeffdingTree* ht, HTTrainConfig config);
+
+// Learns from num_labels more rows, one or many at a time. attr and labels are as in
+// decision_tree_train. Labels not seen before become new classes
+// Learning and predicting may run at the same time from different threads. A call to learn
+// holds the tree for the whole batch, so small batches keep predictions waiting less
+void            hoeffding_tree_learn(HoeffdingTree* ht, int num_labels, float* attr, void* labels);
+
+// Returns the predicted label or value for a single row, from the rows its leaf has learned
+// so far. Classifiers predict -1 and regressors 0 before learning anything
+int             hoeffding_tree_classifier_predict(HoeffdingTree* ht, float* attr);
+float           hoeffding_tree_regressor_predict(HoeffdingTree* ht, float* attr);
+
+// Test a streaming decision tree. Returns the predictions in an array of size num_labels
+int*            hoeffding_tree_classifier_test(HoeffdingTree* ht, int num_labels, float* attr);
+float*          hoeffding_tree_regressor_test(HoeffdingTree* ht, int num_labels, float* attr);
+
+// Returns the number of nodes in the tree
+int             hoeffding_tree_num_nodes(HoeffdingTree* ht);
+
+#endif
@@ -1,5 +1,6 @@
 #include "tests.h"
 #include "decisiontree.h"
+#include "randomforest.h"
 #include "matrix.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,6 +8,28 @@
 
 #define IRIS_CSV_PATH "datasets/iris/iris.csv"
 
+// Infers the feature type of each column from its CSV type. Must be called before csv_encode
+static DTEnum* get_feature_types(CSV* csv, int num_attr, const char** columns)
+{
+    DTEnum* feature_types = malloc(num_attr * sizeof(DTEnum));
+    for (int i = 0; i < num_attr; i++) {
+        switch (csv_column_type(csv, columns[i])) {
+            case CSV_STRING:
+                feature_types[i] = DT_FEATURE_CATEGORICAL;
+                break;
+            case CSV_INT:
+                feature_types[i] = DT_FEATURE_ORDINAL;
+                break;
+            case CSV_FLOAT:
+                feature_types[i] = DT_FEATURE_CONTINUOUS;
+                break;
+            default:
+                feature_types[i] = DT_FEATURE_AUTO;
+        }
+    }
+    return feature_types;
+}
+
 void iris_test(void)
 {
     CSV* csv = csv_read(IRIS_CSV_PATH);
@@ -20,6 +43,16 @@ void iris_test(void)
 
     int num_attr = sizeof(columns) / sizeof(char*);
 
+    // the regressor predicts PetalWidthCm from the species instead
+    const char* regressor_columns[4] = {
+        "SepalLengthCm",
+        "SepalWidthCm",
+        "PetalLengthCm",
+        "Species"
+    };
+    DTEnum* feature_types = get_feature_types(csv, 4, regressor_columns);
+
+    CSVOneHot* species = csv_one_hot_encode_sparse(csv, "Species");
     csv_encode(csv, "Species");
     int* labels = csv_column_int(csv, "Species");
 
@@ -47,6 +80,22 @@ void iris_test(void)
     printf("Prediction: %s\n", csv_decode(csv, label));
     puts("");
 
+    puts("==== Random Forest ====");
+
+    RandomForest* rf = random_forest_create(num_attr, columns);
+    RFTrainConfig rf_config = random_forest_default_config();
+    rf_config.tree = config;
+    rf_config.max_num_threads = 20;
+
+    random_forest_config(rf, rf_config);
+    random_forest_train(rf, csv->num_rows-1, matrix->buffer, labels);
+
+    label = random_forest_classifier_predict(rf, test);
+    printf("Prediction: %s\n", csv_decode(csv, label));
+    puts("");
+
+    random_forest_destroy(rf);
+
     puts("==== Regressor ====");
 
     config.type = DT_REGRESSOR;
@@ -55,12 +104,13 @@ void iris_test(void)
 
     decision_tree_config(dt, config);
 
-    float* labels_float = csv_column_float(csv, "Species");
-    matrix_set_col(matrix, 3, labels_float);
+    float* species_float = csv_one_hot_float(species);
+    matrix_set_col(matrix, 3, species_float);
 
     float* petal_width_cm = csv_column_float(csv, "PetalWidthCm");
 
     decision_tree_set_attr(dt, 4, NULL);
+    decision_tree_set_feature_types(dt, feature_types);
     decision_tree_train(dt, csv->num_rows-1, matrix->buffer, petal_width_cm);
 
     float test2[4] = {7, 3.2, 4.7, 1};
@@ -72,8 +122,11 @@ void iris_test(void)
     matrix_destroy(matrix);
 
     free(petal_width_cm);
-    free(labels_float);
+    free(species_float);
+    free(feature_types);
     free(labels);
 
+    csv_one_hot_destroy(species);
+
     csv_destroy(csv);
 }
@@ -0,0 +1,323 @@
+#include "randomforest.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RF_BLOCK_SIZE 64
+
+typedef struct RandomForest {
+    int num_attr;
+    char** attr_names;
+    RFTrainConfig config;
+    int num_trees;
+    DecisionTree** trees;
+    int num_unique_labels;
+    int* unique_labels;
+} RandomForest;
+
+typedef struct {
+    RandomForest*       rf;
+    int                 num_labels;
+    DTEnum              attr_type;
+    void*               attr;
+    void*               labels;
+    int                 next_tree;
+    pthread_mutex_t     mutex;
+} RFTrainParams;
+
+static void destroy_trees(RandomForest* rf)
+{
+    for (int i = 0; i < rf->num_trees; i++)
+        decision_tree_destroy(rf->trees[i]);
+    free(rf->trees);
+    free(rf->unique_labels);
+    rf->num_trees = 0;
+    rf->trees = NULL;
+    rf->num_unique_labels = 0;
+    rf->unique_labels = NULL;
+}
+
+RandomForest* random_forest_create(int num_attr, const char** attr_names)
+{
+    RandomForest* rf = malloc(sizeof(RandomForest));
+    rf->num_attr = num_attr;
+    rf->attr_names = NULL;
+    if (attr_names != NULL) {
+        rf->attr_names = malloc(num_attr * sizeof(char*));
+        for (int i = 0; i < num_attr; i++) {
+            rf->attr_names[i] = NULL;
+            if (attr_names[i] == NULL)
+                continue;
+            int n = strlen(attr_names[i]);
+            rf->attr_names[i] = malloc((n+1) * sizeof(char));
+            strncpy(rf->attr_names[i], attr_names[i], n+1);
+        }
+    }
+    rf->config = random_forest_default_config();
+    rf->num_trees = 0;
+    rf->trees = NULL;
+    rf->num_unique_labels = 0;
+    rf->unique_labels = NULL;
+    return rf;
+}
+
+void random_forest_destroy(RandomForest* rf)
+{
+    destroy_trees(rf);
+    if (rf->attr_names != NULL)
+        for (int i = 0; i < rf->num_attr; i++)
+            free(rf->attr_names[i]);
+    free(rf->attr_names);
+    free(rf);
+}
+
+RFTrainConfig random_forest_default_config(void)
+{
+    RFTrainConfig config = {
+        .tree = decision_tree_default_config(),
+        .num_trees = 100,
+        .bootstrap = 1,
+        .max_num_threads = 1
+    };
+    config.tree.feature_sampling = DT_FEATURES_SQRT;
+    return config;
+}
+
+void random_forest_config(RandomForest* rf, RFTrainConfig config)
+{
+    rf->config = config;
+}
+
+static int validate_config(RFTrainConfig* config)
+{
+    if (config->num_trees <= 0) {
+        puts("Config num trees must be greater than 0");
+        return 0;
+    }
+
+    if (config->max_num_threads <= 0) {
+        puts("Config max num threads must be greater than 0");
+        return 0;
+    }
+
+    return decision_tree_validate_config(config->tree);
+}
+
+static void get_unique_labels(RandomForest* rf, int num_labels, int* labels)
+{
+    int i, j;
+
+    rf->num_unique_labels = 0;
+    rf->unique_labels = malloc(num_labels * sizeof(int));
+    for (i = 0; i < num_labels; i++) {
+        for (j = 0; j < rf->num_unique_labels; j++)
+            if (labels[i] == rf->unique_labels[j])
+                break;
+        if (j == rf->num_unique_labels)
+            rf->unique_labels[rf->num_unique_labels++] = labels[i];
+    }
+}
+
+// Each worker takes the next untrained tree until there are none left. A tree's bootstrap
+// sample and attribute choices come from a generator seeded with the forest's seed and the
+// tree's index, so the forest does not depend on the number of threads
+static void* random_forest_train_worker(void* void_params)
+{
+    RFTrainParams*      params          = void_params;
+    RandomForest*       rf              = params->rf;
+    int                 num_labels      = params->num_labels;
+
+    DTTrainConfig tree_config;
+    float* weights;
+    int tree_idx, label_idx;
+    uint64_t rng;
+
+    tree_config = rf->config.tree;
+    tree_config.max_num_threads = 1;
+    weights = malloc(num_labels * sizeof(float));
+
+    while (1) {
+        pthread_mutex_lock(&params->mutex);
+        tree_idx = params->next_tree++;
+        pthread_mutex_unlock(&params->mutex);
+        if (tree_idx >= rf->num_trees)
+            break;
+
+        rng = ((uint64_t)rf->config.tree.seed << 32) ^ tree_idx;
+        decision_tree_rng_next(&rng);
+        if (rf->config.bootstrap) {
+            memset(weights, 0, num_labels * sizeof(float));
+            for (label_idx = 0; label_idx < num_labels; label_idx++)
+                weights[decision_tree_rng_next(&rng) % num_labels]++;
+        }
+
+        tree_config.seed = decision_tree_rng_next(&rng);
+        decision_tree_config(rf->trees[tree_idx], tree_config);
+        decision_tree_train_bagged(rf->trees[tree_idx], num_labels, params->attr_type, params->attr,
+                                   params->labels, (rf->config.bootstrap) ? weights : NULL);
+    }
+
+    free(weights);
+
+    return NULL;
+}
+
+void random_forest_train(RandomForest* rf, int num_labels, float* attr, void* labels)
+{
+    random_forest_train_typed(rf, num_labels, DT_ATTR_FLOAT, attr, labels);
+}
+
+void random_forest_train_typed(RandomForest* rf, int num_labels, DTEnum attr_type, void* attr, void* labels)
+{
+    RFTrainParams params;
+    pthread_t* threads;
+    int i, num_threads;
+
+    if (!validate_config(&rf->config))
+        return;
+
+    params.attr = decision_tree_feature_major(num_labels, rf->num_attr, attr_type, attr);
+    if (params.attr == NULL)
+        return;
+
+    destroy_trees(rf);
+    rf->num_trees = rf->config.num_trees;
+    rf->trees = malloc(rf->num_trees * sizeof(DecisionTree*));
+    for (i = 0; i < rf->num_trees; i++)
+        rf->trees[i] = decision_tree_create(rf->num_attr, (const char**)rf->attr_names);
+    if (rf->config.tree.type == DT_CLASSIFIER)
+        get_unique_labels(rf, num_labels, labels);
+
+    params.rf = rf;
+    params.num_labels = num_labels;
+    params.attr_type = attr_type;
+    params.labels = labels;
+    params.next_tree = 0;
+    pthread_mutex_init(&params.mutex, NULL);
+
+    num_threads = (rf->config.max_num_threads < rf->num_trees) ? rf->config.max_num_threads : rf->num_trees;
+    threads = malloc(num_threads * sizeof(pthread_t));
+
+    puts("Training random forest");
+    clock_t t = clock();
+    for (i = 1; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, random_forest_train_worker, &params);
+    random_forest_train_worker(&params);
+    for (i = 1; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    t = clock() - t;
+    printf("Trained %d trees in %f s\n", rf->num_trees, ((double)t)/CLOCKS_PER_SEC);
+
+    pthread_mutex_destroy(&params.mutex);
+    free(threads);
+    free(params.attr);
+}
+
+static int get_label_id(RandomForest* rf, int label)
+{
+    for (int i = 0; i < rf->num_unique_labels; i++)
+        if (rf->unique_labels[i] == label)
+            return i;
+    return -1;
+}
+
+// Runs every tree over a block of rows, tree by tree, so each tree's nodes stay in cache for
+// the whole block. votes holds num_rows * num_unique_labels counts, sums num_rows values
+static void predict_block(RandomForest* rf, int num_rows, DTEnum attr_type, char* attr, int row_size, int* votes, float* sums)
+{
+    int tree_idx, row, id;
+    DecisionTree* tree;
+
+    for (tree_idx = 0; tree_idx < rf->num_trees; tree_idx++) {
+        tree = rf->trees[tree_idx];
+        for (row = 0; row < num_rows; row++) {
+            if (votes != NULL) {
+                id = get_label_id(rf, decision_tree_classifier_predict_typed(tree, attr_type, attr + (size_t)row * row_size));
+                if (id != -1)
+                    votes[row * rf->num_unique_labels + id]++;
+            } else {
+                sums[row] += decision_tree_regressor_predict_typed(tree, attr_type, attr + (size_t)row * row_size);
+            }
+        }
+    }
+}
+
+int* random_forest_classifier_test_typed(RandomForest* rf, int num_labels, DTEnum attr_type, void* attr)
+{
+    int row_size = rf->num_attr * decision_tree_attr_type_size(attr_type);
+    int* predictions = malloc(num_labels * sizeof(int));
+    int* votes;
+    int* row_votes;
+    int block, num_rows, row, i, best;
+
+    if (rf->num_unique_labels == 0) {
+        memset(predictions, 0, num_labels * sizeof(int));
+        return predictions;
+    }
+
+    votes = malloc(RF_BLOCK_SIZE * rf->num_unique_labels * sizeof(int));
+    for (block = 0; block < num_labels; block += RF_BLOCK_SIZE) {
+        num_rows = (num_labels - block < RF_BLOCK_SIZE) ? num_labels - block : RF_BLOCK_SIZE;
+        memset(votes, 0, num_rows * rf->num_unique_labels * sizeof(int));
+        predict_block(rf, num_rows, attr_type, (char*)attr + (size_t)block * row_size, row_size, votes, NULL);
+        for (row = 0; row < num_rows; row++) {
+            row_votes = votes + row * rf->num_unique_labels;
+            best = 0;
+            for (i = 1; i < rf->num_unique_labels; i++)
+                if (row_votes[i] > row_votes[best])
+                    best = i;
+            predictions[block + row] = rf->unique_labels[best];
+        }
+    }
+    free(votes);
+
+    return predictions;
+}
+
+float* random_forest_regressor_test_typed(RandomForest* rf, int num_labels, DTEnum attr_type, void* attr)
+{
+    int row_size = rf->num_attr * decision_tree_attr_type_size(attr_type);
+    float* predictions = calloc(num_labels, sizeof(float));
+    int block, num_rows, row;
+
+    if (rf->num_trees == 0)
+        return predictions;
+
+    for (block = 0; block < num_labels; block += RF_BLOCK_SIZE) {
+        num_rows = (num_labels - block < RF_BLOCK_SIZE) ? num_labels - block : RF_BLOCK_SIZE;
+        predict_block(rf, num_rows, attr_type, (char*)attr + (size_t)block * row_size, row_size, NULL, predictions + block);
+        for (row = 0; row < num_rows; row++)
+            predictions[block + row] /= rf->num_trees;
+    }
+
+    return predictions;
+}
+
+int* random_forest_classifier_test(RandomForest* rf, int num_labels, float* attr)
+{
+    return random_forest_classifier_test_typed(rf, num_labels, DT_ATTR_FLOAT, attr);
+}
+
+float* random_forest_regressor_test(RandomForest* rf, int num_labels, float* attr)
+{
+    return random_forest_regressor_test_typed(rf, num_labels, DT_ATTR_FLOAT, attr);
+}
+
+int random_forest_classifier_predict(RandomForest* rf, float* attr)
+{
+    int* predictions = random_forest_classifier_test(rf, 1, attr);
+    int label = predictions[0];
+    free(predictions);
+    return label;
+}
+
+float random_forest_regressor_predict(RandomForest* rf, float* attr)
+{
+    float* predictions = random_forest_regressor_test(rf, 1, attr);
+    float value = predictions[0];
+    free(predictions);
+    return value;
+}
@@ -0,0 +1,54 @@
+#ifndef RANDOMFOREST_H
+#define RANDOMFOREST_H
+
+#include "decisiontree.h"
+
+typedef struct RandomForest RandomForest;
+
+typedef struct {
+    DTTrainConfig   tree;
+    int             num_trees;
+    int             bootstrap;
+    int             max_num_threads;
+} RFTrainConfig;
+
+// Create a random forest with the default config and num_attr names, specified in attr_names
+// Passing NULL as attr_names will make unnamed attributes
+RandomForest*   random_forest_create(int num_attr, const char** attr_names);
+
+// Destroy a random forest and its trees
+void            random_forest_destroy(RandomForest* rf);
+
+// Returns the default config:
+//      tree = decision_tree_default_config() with feature_sampling = DT_FEATURES_SQRT
+//      num_trees = 100
+//      bootstrap = 1, each tree is trained on num_labels rows drawn with replacement
+//      max_num_threads = 1, trees are trained in parallel on up to this many threads
+// Every tree is trained with the tree config, except that each runs on one thread and draws
+// from its own seed, derived from tree.seed and its index. tree.feature_sampling and
+// tree.max_features choose the attributes each split considers, for regressors usually
+// DT_FEATURES_FRACTION with max_features = 1/3
+RFTrainConfig   random_forest_default_config(void);
+
+// Sets the config for the current random forest
+void            random_forest_config(RandomForest* rf, RFTrainConfig config);
+
+// Trains the trees of the random forest. Arguments are the same as decision_tree_train and
+// decision_tree_train_typed. The attributes are copied into feature-major order once and
+// shared by every tree
+void            random_forest_train(RandomForest* rf, int num_labels, float* attr, void* labels);
+void            random_forest_train_typed(RandomForest* rf, int num_labels, DTEnum attr_type, void* attr, void* labels);
+
+// Test a random forest. Returns the predictions in an array of size num_labels
+// Rows are predicted in blocks, running every tree over a block before moving to the next
+// Classifiers predict the majority vote of the trees, regressors the average
+int*            random_forest_classifier_test(RandomForest* rf, int num_labels, float* attr);
+float*          random_forest_regressor_test(RandomForest* rf, int num_labels, float* attr);
+int*            random_forest_classifier_test_typed(RandomForest* rf, int num_labels, DTEnum attr_type, void* attr);
+float*          random_forest_regressor_test_typed(RandomForest* rf, int num_labels, DTEnum attr_type, void* attr);
+
+// Returns the predicted label or value for a single row
+int             random_forest_classifier_predict(RandomForest* rf, float* attr);
+float           random_forest_regressor_predict(RandomForest* rf, float* attr);
+
+#endif